@@ -12,8 +12,10 @@ struct GlobCvt {
   CHAR * out; /* utf8 or utf32 char classes */
   size_t off, /* off will be > maxlen on buf space failure */
          maxlen;
+  bool   use_commit; /* (*COMMIT) at stars, not when part of an alternation */
 
-  GlobCvt( CHAR *o, size_t len ) : out( o ), off( 0 ), maxlen( len ) {}
+  GlobCvt( CHAR *o, size_t len ) : out( o ), off( 0 ), maxlen( len ),
+                                   use_commit( true ) {}
 
   void char_out( CHAR c ) {
     if ( ++this->off <= this->maxlen )
@@ -72,9 +74,11 @@ struct GlobCvt {
         else if ( ! inside_bracket ) {
           if ( pattern[ k ] == '*' ) {
             if ( k > 0 && pattern[ k - 1 ] == '*' )
-              k++; /* skip duplicate '*' */
-            else
+              ; /* skip duplicate '*' */
+            else if ( this->use_commit )
               this->str_out( "(*COMMIT).*?", 12 ); /* commit and star */
+            else
+              this->str_out( ".*?", 3 );
           }
           else if ( pattern[ k ] == '?' ) {
             this->char_out( '.' );
@@ -0,0 +1,208 @@
+#ifndef __rdbparser__rdb_copy_h__
+#define __rdbparser__rdb_copy_h__
+
+#include <rdbparser/rdb_write.h>
+#include <rdbparser/rdb_slot.h>
+
+#ifdef __cplusplus
+namespace rdbparser {
+
+/* an output file of RdbCopyOutput */
+struct RdbCopyFile {
+  RdbWriter w;          /* buffered output */
+  char    * fn;         /* file name */
+  uint64_t  copy_cnt;   /* count of keys copied */
+  bool      db_open;    /* SELECTDB db written */
+
+  RdbCopyFile() : fn( 0 ), copy_cnt( 0 ), db_open( false ) {}
+  ~RdbCopyFile() {
+    if ( this->fn != NULL )
+      ::free( this->fn );
+  }
+};
+
+/* copy the keys which pass the filter from one rdb file to another
+ *
+ * the record of a key, the expire, idle and freq opcodes, the type, the
+ * key and the value, is copied from the input without decoding it again,
+ * the aux fields are copied, SELECTDB is written only for databases with
+ * keys copied, RESIZEDB is copied from the input when all of the keys are
+ * copied to one file, otherwise the counts are not known until the db is
+ * written and it is left out, bptr must be the input buffer and copy_key()
+ * is called after each key is skipped and the lzf allocations are released
+ *
+ * with a slot map, each output of the map is a file named fn.name.rdb and
+ * each key is copied to the file of its hash slot */
+struct RdbCopyOutput : public RdbOutput {
+  RdbBufptr   & bptr;        /* input buffer */
+  RdbSlotMap  * map;         /* split keys by slot, if not null */
+  RdbCopyFile * file;        /* file[ file_cnt ] */
+  size_t        file_cnt,    /* 1 or map->out_cnt */
+                cur;         /* file of the matched key */
+  const char  * fn;          /* output file name or prefix */
+  uint64_t      rec_start,   /* stream offset of the key record */
+                db,          /* db of the input */
+                db_size,     /* RESIZEDB of the input db */
+                db_expires,
+                copy_cnt;    /* count of keys copied */
+  bool          is_open,     /* output files created */
+                has_resize,  /* input db has RESIZEDB */
+                has_expire,  /* key record has an expire */
+                is_matched,  /* key passed filter */
+                failed;      /* an error occurred */
+
+  RdbCopyOutput( RdbDecode &dec,  RdbBufptr &b,  const char *f )
+    : RdbOutput( dec ), bptr( b ), map( 0 ), file( 0 ), file_cnt( 0 ),
+      cur( 0 ), fn( f ), rec_start( 0 ), db( 0 ), db_size( 0 ),
+      db_expires( 0 ), copy_cnt( 0 ), is_open( false ), has_resize( false ),
+      has_expire( false ), is_matched( false ),
+      failed( false ) {}
+  ~RdbCopyOutput() { this->release(); }
+  void release( void ) noexcept;
+
+  uint64_t stream_offset( void ) const {
+    return this->bptr.start_offset + this->bptr.offset;
+  }
+  /* create the outputs with the version of the input */
+  bool open( void ) noexcept;
+  /* copy the key just decoded, if it matched */
+  void copy_key( void ) noexcept;
+
+  virtual void d_finish( bool success ) noexcept;
+  virtual void d_aux( const RdbString &var,  const RdbString &val ) noexcept;
+  virtual void d_dbresize( uint64_t i,  uint64_t j ) noexcept;
+  virtual void d_expired_ms( uint64_t ms ) noexcept;
+  virtual void d_expired( uint32_t sec ) noexcept;
+  virtual void d_dbselect( uint32_t db ) noexcept;
+  virtual void d_start_type( RdbType t ) noexcept;
+  virtual void d_start_key( void ) noexcept;
+};
+
+/* a key in RdbKeySet, the bytes are in RdbKeySet::buf */
+struct RdbKeySetEntry {
+  uint64_t hash, /* hash of key and db, zero is an empty slot */
+           db;   /* db of key */
+  size_t   off,  /* offset of key in buf */
+           len;  /* length of key */
+};
+
+/* a set of keys with db, open addressing, the keys are copied to buf and
+ * compared when the hash matches, integer keys are the decimal string */
+struct RdbKeySet {
+  RdbKeySetEntry * tab;      /* tab[ mask + 1 ] */
+  char           * buf;      /* key bytes */
+  size_t           mask,     /* size - 1, a power of 2 */
+                   cnt,      /* number of keys in tab */
+                   buf_len,  /* bytes used in buf */
+                   buf_size; /* size of buf */
+
+  RdbKeySet() : tab( 0 ), buf( 0 ), mask( 0 ), cnt( 0 ), buf_len( 0 ),
+    buf_size( 0 ) {}
+  ~RdbKeySet() {
+    if ( this->tab != NULL )
+      ::free( this->tab );
+    if ( this->buf != NULL )
+      ::free( this->buf );
+  }
+  /* add key, return false if already present or no memory (failed set) */
+  bool insert( const RdbString &key,  uint64_t db,  bool &failed ) noexcept;
+  bool grow( void ) noexcept;
+  bool add_key( const char *key,  size_t len ) noexcept;
+  static uint64_t hash( const char *key,  size_t len,  uint64_t db ) noexcept;
+};
+
+enum RdbMergePolicy {
+  MERGE_FIRST = 0, /* first input with a key wins */
+  MERGE_LAST  = 1, /* last input with a key wins */
+  MERGE_ERROR = 2  /* a key in more than one input is an error */
+};
+
+struct RdbMerge;
+
+/* an input of RdbMerge, one key header is decoded ahead so that the db of
+ * the next key is known */
+struct RdbMergeInput : public RdbOutput {
+  RdbMerge      & merge;
+  RdbBufptr       bptr;        /* the mapped file */
+  const char    * fn;          /* file name */
+  uint64_t        rec_start,   /* stream offset of the key record */
+                  db,          /* db of the next key */
+                  db_size,     /* RESIZEDB of the db */
+                  db_expires,
+                  copy_cnt;    /* count of keys copied */
+  size_t          idx;         /* index of input, 0 copies aux */
+  bool            has_expire,  /* key record has an expire */
+                  is_dup,      /* key is in an input already merged */
+                  is_eof;      /* no more keys */
+
+  RdbMergeInput( RdbDecode &d,  RdbMerge &m,  const uint8_t *b,  size_t sz,
+                 const char *f,  size_t i )
+    : RdbOutput( d ), merge( m ), bptr( b, sz ), fn( f ), rec_start( 0 ),
+      db( 0 ), db_size( 0 ), db_expires( 0 ), copy_cnt( 0 ), idx( i ),
+      has_expire( false ),
+      is_dup( false ), is_eof( false ) {}
+
+  uint64_t stream_offset( void ) const {
+    return this->bptr.start_offset + this->bptr.offset;
+  }
+  /* decode the header of the next key, false on eof or error */
+  bool next_hdr( void ) noexcept;
+  /* skip over the body of the key and copy it, unless it is a dup */
+  bool copy_key( void ) noexcept;
+
+  virtual void d_aux( const RdbString &var,  const RdbString &val ) noexcept;
+  virtual void d_dbresize( uint64_t i,  uint64_t j ) noexcept;
+  virtual void d_expired_ms( uint64_t ms ) noexcept;
+  virtual void d_expired( uint32_t sec ) noexcept;
+  virtual void d_dbselect( uint32_t db ) noexcept;
+  virtual void d_start_key( void ) noexcept;
+};
+
+/* a decoder and its merge input */
+struct RdbMergeFile {
+  RdbDecode     dec;
+  RdbMergeInput in;
+
+  RdbMergeFile( RdbMerge &m,  const uint8_t *b,  size_t sz,  const char *f,
+                size_t i ) : in( dec, m, b, sz, f, i ) {
+    this->dec.data_out = &this->in;
+    this->dec.is_skip  = true; /* the record is copied, not decoded */
+  }
+};
+
+/* merge rdb files into one
+ *
+ * the inputs are decoded together one db at a time, the dbs of each input
+ * are in order (as redis saves them), so the output has one SELECTDB for
+ * each db with the keys of all the inputs, the key records are copied as
+ * they are, the output version is the highest input version and the
+ * aux fields of the first input are copied, conflicting keys are found
+ * with a set of keys, RESIZEDB is the sum of the inputs, which is exact
+ * unless keys conflict */
+struct RdbMerge {
+  RdbWriter      w;           /* output */
+  RdbMergeFile ** file;       /* file[ file_cnt ] */
+  size_t         file_cnt,
+                 err_idx;     /* input with decode error */
+  RdbKeySet      keys;        /* keys merged, with db */
+  RdbMergePolicy policy;      /* which input a conflicting key is from */
+  RdbErrCode     err;         /* decode error */
+  uint64_t       dup_cnt;     /* keys skipped which are in more than one */
+  bool           failed;      /* error occurred */
+
+  RdbMerge() : file( 0 ), file_cnt( 0 ), err_idx( 0 ), policy( MERGE_ERROR ),
+    err( RDB_OK ), dup_cnt( 0 ),
+    failed( false ) {}
+  ~RdbMerge() { this->release(); }
+  void release( void ) noexcept;
+
+  /* add a mapped rdb file */
+  bool add_input( const uint8_t *b,  size_t sz,  const char *fn ) noexcept;
+  /* create the output fn and merge the inputs to it, fn is removed if it
+   * fails */
+  bool run( const char *fn ) noexcept;
+};
+
+} // namespace
+#endif
+#endif
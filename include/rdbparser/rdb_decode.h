@@ -674,7 +674,8 @@ struct RdbOutput {
   virtual void d_init( void ) noexcept;       /* start main */
   /* callled last */
   virtual void d_finish( bool success ) noexcept; /* finish main */
-  /* meta info, the idle, freq, expired belong to the next key */
+  /* meta info, the idle, freq, expired belong to the next key, these are
+   * passed to data_out by start_key() after the key filter matches */
   virtual void d_idle( uint64_t i ) noexcept;
   virtual void d_freq( uint8_t f ) noexcept;
   virtual void d_aux( const RdbString &var,  const RdbString &val ) noexcept;
@@ -748,27 +749,53 @@ struct RdbDecode {
   RdbType     type;     /* the type of the record being decoded */
   uint64_t    crc;      /* trail crc check, if present */
   RdbString   key;      /* the key in a rdb file, not in a dump */
-  uint64_t    key_cnt;  /* count of keys decoded */
+  uint64_t    key_cnt,  /* count of keys decoded */
+              db,       /* db of the key, from the last select db */
+              expire_ms,/* expire of the key, zero if none */
+              idle;     /* idle of the key, if has_idle */
   uint16_t    ver;      /* rdb ver check */
-  bool        is_rdb_file; /* "dump" or "save" used, if "save", then true */
+  uint8_t     freq;     /* freq of the key, if has_freq */
+  bool        is_rdb_file, /* "dump" or "save" used, if "save", then true */
+              is_skip,  /* skip_body() is used, value is not unzipped */
+              has_idle, /* idle is present in the header of the key */
+              has_freq, /* freq is present in the header of the key */
+              is_expire_sec, /* expire_ms is from an expire in seconds */
+              is_matched, /* filter matched the key in decode_hdr() */
+              is_unzipped; /* the value was lzf decompressed */
 
   RdbDecode()
     : out( 0 ), data_out( 0 ), null_out( *this ), filter( 0 ),
-      type( RDB_BAD_TYPE ), crc( 0 ), key_cnt( 0 ), ver( 0 ),
-      is_rdb_file( false ) {}
+      type( RDB_BAD_TYPE ), crc( 0 ), key_cnt( 0 ), db( 0 ), expire_ms( 0 ),
+      idle( 0 ), ver( 0 ), freq( 0 ), is_rdb_file( false ), is_skip( false ),
+      has_idle( false ), has_freq( false ), is_expire_sec( false ),
+      is_matched( true ),
+      is_unzipped( false ) {}
 
-  /* call filter if present and set up output */
+  /* set up output for the filter result of decode_hdr() */
   void start_key( void ) {
-    if ( this->filter == NULL || this->filter->match_key( this->key ) )
+    if ( this->is_matched ) {
       this->out = this->data_out;
+      this->key_meta();
+    }
     else
       this->out = &this->null_out;
     this->out->d_start_key();
   }
-  /* determine type, crc check */
+  /* pass the expire, idle and freq of the matched key to out */
+  void key_meta( void ) noexcept;
+  /* determine type, crc check, the filter is called with the key and the
+   * meta above, the value of a key which doesn't match is not unzipped
+   * and decode_body() skips it */
   RdbErrCode decode_hdr( RdbBufptr &bptr ) noexcept;
   /* iterate through the elements in the dump */
   RdbErrCode decode_body( RdbBufptr &bptr ) noexcept;
+  /* move past the value without decoding the elements, only the lengths
+   * are decoded, calls start_key() and d_end_key(), but not the element
+   * outputs, streams and modules are decoded, is_skip must be set before
+   * decode_hdr() so that the value is not unzipped */
+  RdbErrCode skip_body( RdbBufptr &bptr ) noexcept;
+  /* move past a string, without unzipping it */
+  static RdbErrCode skip_str( RdbBufptr &bptr ) noexcept;
   /* decode a HASH_ZIPMAP type */
   RdbErrCode decode_hash_zipmap( RdbBufptr &bptr ) noexcept;
   /* decode a SET_INTSET type */
@@ -798,6 +825,7 @@ void print_hex( const char *nm, size_t off, size_t end,
                 const uint8_t *b ) noexcept;
 
 uint64_t jones_crc64( uint64_t crc, const void *buf, size_t len ) noexcept;
+uint64_t xxh64( uint64_t seed,  const void *buf,  size_t len ) noexcept;
 
 } // namespace
 #endif
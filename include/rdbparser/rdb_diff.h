@@ -0,0 +1,189 @@
+#ifndef __rdbparser__rdb_diff_h__
+#define __rdbparser__rdb_diff_h__
+
+#include <rdbparser/rdb_decode.h>
+
+#ifdef __cplusplus
+namespace rdbparser {
+
+/* the hashes of a key record */
+struct RdbKeyHash {
+  RdbString key;       /* the key, only valid while called */
+  uint64_t  db,        /* db of the key */
+            key_hash,  /* xxh64 of key */
+            val_hash,  /* xxh64 of the encoded type and value, with expire */
+            rec_len,   /* size of the encoded type, key and value */
+            expire_ms; /* expire or zero */
+  RdbType   type;      /* type of value */
+
+  RdbKeyHash() : db( 0 ), key_hash( 0 ), val_hash( 0 ), rec_len( 0 ),
+                 expire_ms( 0 ), type( RDB_BAD_TYPE ) {}
+};
+
+/* receives the hash of each key */
+struct RdbHashSink {
+  virtual void key_hash( const RdbKeyHash &kh ) noexcept = 0;
+};
+
+/* hash the raw bytes of each key record, the value is not decoded again or
+ * compared element by element, so the same data encoded differently has a
+ * different hash, hash_key() is called after each key is decoded and the
+ * lzf allocations are released */
+struct RdbHashOutput : public RdbOutput {
+  RdbBufptr   & bptr;       /* input buffer */
+  RdbHashSink * sink;       /* where hashes go */
+  char        * key_buf;    /* copy of key, it may be lzf decompressed */
+  size_t        key_size;   /* size of key_buf */
+  RdbKeyHash    kh;         /* the hashes of the current key */
+  uint64_t      type_off;   /* stream offset of the type byte */
+  bool          is_matched; /* key passed filter */
+
+  RdbHashOutput( RdbDecode &dec,  RdbBufptr &b,  RdbHashSink *s )
+    : RdbOutput( dec ), bptr( b ), sink( s ), key_buf( 0 ), key_size( 0 ),
+      type_off( 0 ), is_matched( false ) {}
+  ~RdbHashOutput() {
+    if ( this->key_buf != NULL )
+      ::free( this->key_buf );
+  }
+  uint64_t stream_offset( void ) const {
+    return this->bptr.start_offset + this->bptr.offset;
+  }
+  /* hash the key just decoded and pass it to sink, if it matched */
+  void hash_key( void ) noexcept;
+
+  virtual void d_expired_ms( uint64_t ms ) noexcept;
+  virtual void d_expired( uint32_t sec ) noexcept;
+  virtual void d_dbselect( uint32_t db ) noexcept;
+  virtual void d_start_type( RdbType t ) noexcept;
+  virtual void d_start_key( void ) noexcept;
+};
+
+/* decode the mapped rdb file buf and pass the hash of each key to sink */
+RdbErrCode hash_rdb_keys( const uint8_t *buf,  size_t len,
+                          RdbHashSink &sink ) noexcept;
+
+/* a key in a diff partition or an index file, the key bytes follow,
+ * padded to 8 */
+struct RdbDiffEntry {
+  uint64_t key_hash,
+           val_hash,
+           len_type; /* rec_len << 8 | type */
+  uint32_t db,       /* DIFF_MATCHED bit is set when found in the new */
+           key_len;
+
+  void set( const RdbKeyHash &kh ) {
+    this->key_hash = kh.key_hash;
+    this->val_hash = kh.val_hash;
+    this->len_type = ( kh.rec_len << 8 ) | (uint8_t) kh.type;
+    this->db       = (uint32_t) kh.db;
+    this->key_len  = (uint32_t) kh.key.s_len;
+  }
+  const char *key( void ) const { return (const char *) &this[ 1 ]; }
+  size_t size( void ) const {
+    return sizeof( RdbDiffEntry ) + ( ( (size_t) this->key_len + 7 ) & ~7 );
+  }
+  /* write entry and key, false if failed */
+  bool write( FILE *fp,  const char *key ) const noexcept;
+};
+
+/* print the hashes of each key to stdout, either as tab separated text:
+ *   db  "key"  type  rec_len  val_hash
+ * or in the binary index format of RdbDelta */
+struct RdbFingerprint : public RdbHashSink {
+  bool is_binary, /* index format instead of text */
+       failed;    /* write error */
+
+  RdbFingerprint( bool bin ) : is_binary( bin ), failed( false ) {}
+  bool start( void ) noexcept; /* write the binary header */
+  virtual void key_hash( const RdbKeyHash &kh ) noexcept;
+};
+
+/* compare the keys of two snapshots, the old one is loaded first into
+ * memory, when it is larger than mem_limit, both are partitioned by key
+ * hash into temporary files and each partition is joined separately,
+ * the differences are printed as:
+ *   + db "key"   (added)
+ *   - db "key"   (removed)
+ *   ~ db "key"   (value or expire changed) */
+struct RdbDiff : public RdbHashSink {
+  static const uint32_t DIFF_MATCHED = 0x80000000U;
+  static const size_t   DIFF_PARTS   = 64;
+
+  uint8_t  * buf;          /* old entries in memory */
+  size_t     buf_len,      /* bytes used in buf */
+             buf_size,     /* size of buf */
+             mem_limit,    /* spill when buf is larger */
+           * tab,          /* buf offset + 1 of entries, by key_hash */
+             tab_mask;     /* tab size - 1 */
+  FILE     * part[ 2 ][ DIFF_PARTS ]; /* spilled old and new entries */
+  int        side;         /* 0 = old, 1 = new, where key_hash() goes */
+  bool       is_spilled,   /* using part[] files */
+             failed;       /* error occurred */
+  uint64_t   add_cnt,      /* keys in new, not in old */
+             rem_cnt,      /* keys in old, not in new */
+             chg_cnt,      /* keys in both with different values */
+             same_cnt;     /* keys in both with the same value */
+
+  RdbDiff( size_t mem ) : buf( 0 ), buf_len( 0 ), buf_size( 0 ),
+    mem_limit( mem ), tab( 0 ), tab_mask( 0 ), side( 0 ), is_spilled( false ),
+    failed( false ), add_cnt( 0 ), rem_cnt( 0 ), chg_cnt( 0 ), same_cnt( 0 ) {
+    ::memset( this->part, 0, sizeof( this->part ) );
+  }
+  ~RdbDiff() { this->release(); }
+  void release( void ) noexcept;
+
+  /* RdbHashSink, an entry of the old or new snapshot */
+  virtual void key_hash( const RdbKeyHash &kh ) noexcept;
+  /* after the old is added, prepare for the new */
+  void start_new( void ) noexcept;
+  /* after the new is added, print the removed and the spilled differences */
+  bool finish( void ) noexcept;
+
+  bool append( const RdbKeyHash &kh ) noexcept;
+  bool spill( void ) noexcept;
+  bool write_part( int s,  const RdbDiffEntry &e,  const char *key ) noexcept;
+  bool load_part( FILE *fp ) noexcept;
+  bool build_tab( void ) noexcept;
+  /* find e in the old entries, return '+' (added), '~' (changed) or
+   * '=' (same) */
+  char probe( const RdbDiffEntry &e,  const char *key ) noexcept;
+  void print_removed( void ) noexcept;
+  virtual void print_key( char c,  uint32_t db,  const char *key,
+                          size_t len ) noexcept;
+};
+
+struct RestoreOutput;
+
+/* the keys of the previous snapshot, loaded from it or from an index file
+ * written by the previous run, so that only the keys added or changed are
+ * restored and the keys removed are deleted, the old keys are not spilled
+ *
+ * the index file is "RDBPIDX2" followed by RdbDiffEntry records in host
+ * byte order */
+struct RdbDelta : public RdbDiff {
+  RestoreOutput * out;   /* where DEL commands are written */
+  FILE          * idx;   /* index of the new snapshot, if not null */
+  const char    * idx_fn;
+
+  RdbDelta() : RdbDiff( ~(size_t) 0 ), out( 0 ), idx( 0 ), idx_fn( 0 ) {}
+  ~RdbDelta() {
+    if ( this->idx != NULL )
+      ::fclose( this->idx );
+  }
+  /* load old entries from an index file */
+  bool load_index( const char *fn ) noexcept;
+  /* create an index file for the new snapshot */
+  bool open_index( const char *fn ) noexcept;
+  /* return true if the key should be restored, add it to the new index */
+  bool check( uint64_t db,  const RdbString &key,  RdbType type,
+              uint64_t rec_len,  uint64_t val_hash ) noexcept;
+  /* delete the old keys not in the new, close the index */
+  bool finish_delta( void ) noexcept;
+  /* write DEL for removed keys */
+  virtual void print_key( char c,  uint32_t db,  const char *key,
+                          size_t len ) noexcept;
+};
+
+} // namespace
+#endif
+#endif
@@ -262,7 +262,7 @@ struct RdbListPackEncode {
         b[ this->off++ ] = (uint8_t) val;
         break;
       case RdbListPack::LP_13BIT_INT:
-        b[ this->off++ ] = 0xc0 | (uint8_t) ( ( val >> 8 ) & 0xf );
+        b[ this->off++ ] = 0xc0 | (uint8_t) ( ( val >> 8 ) & 0x1f );
         b[ this->off++ ] = (uint8_t) ( val & 0xff );
         break;
       case RdbListPack::LP_16BIT_INT:
@@ -272,9 +272,9 @@ struct RdbListPackEncode {
         break;
       case RdbListPack::LP_24BIT_INT:
         b[ this->off++ ] = 0xf2;
-        b[ this->off++ ] = (uint8_t) ( ( val & 0xff0000 ) >> 16 );
         le<uint16_t>( &b[ this->off ], val & 0xffff );
-        this->off += 2;
+        b[ this->off + 2 ] = (uint8_t) ( ( val & 0xff0000 ) >> 16 );
+        this->off += 3;
         break;
       case RdbListPack::LP_32BIT_INT:
         b[ this->off++ ] = 0xf3;
@@ -351,6 +351,217 @@ struct RdbListPackEncode {
   }
 };
 
+/* growable output for the single pass builders below */
+struct RdbBuildBuf {
+  uint8_t * buf;      /* encoded data */
+  size_t    buf_size; /* size allocated */
+  bool      failed;   /* if realloc failed */
+
+  RdbBuildBuf() : buf( 0 ), buf_size( 0 ), failed( false ) {}
+  ~RdbBuildBuf() {
+    if ( this->buf != NULL )
+      ::free( this->buf );
+  }
+  /* make room for len more bytes at off, return false if out of memory */
+  bool reserve( size_t off,  size_t len ) {
+    if ( off + len <= this->buf_size )
+      return true;
+    size_t sz = ( this->buf_size == 0 ? 1024 : this->buf_size * 2 );
+    while ( sz < off + len )
+      sz *= 2;
+    uint8_t * p = (uint8_t *) ::realloc( this->buf, sz );
+    if ( p == NULL ) {
+      this->failed = true;
+      return false;
+    }
+    this->buf      = p;
+    this->buf_size = sz;
+    return true;
+  }
+};
+
+/* encode a ziplist in one pass, the header is patched by finish():
+ *   RdbZipBuild zb;
+ *   zb.start();
+ *   zb.append_str( "one", 3 ); zb.append_int( 2 );
+ *   len = zb.finish();  -- zb.buf[ 0 .. len ] is the ziplist */
+struct RdbZipBuild : public RdbBuildBuf {
+  RdbZipEncode enc;
+  uint32_t     count; /* number of entries */
+
+  RdbZipBuild() : count( 0 ) { this->enc.init(); }
+
+  void start( void ) {
+    this->enc.init( this->buf );
+    this->count  = 0;
+    this->failed = false;
+  }
+  bool reserve( size_t len ) {
+    if ( ! this->RdbBuildBuf::reserve( this->enc.off, len ) )
+      return false;
+    this->enc.p = this->buf;
+    return true;
+  }
+  /* prev is at most 5 bytes, next is at most 5 bytes */
+  static size_t max_link( size_t sz ) { return 10 + sz; }
+
+  void append_str( const void *s,  size_t len ) {
+    if ( this->reserve( max_link( len ) ) ) {
+      this->enc.append_link( s, (uint32_t) len );
+      this->count++;
+    }
+  }
+  /* integers are stored as strings, same as the RdbZipEncode passes */
+  void append_int( int64_t ival ) {
+    char tmp[ 24 ];
+    int  n = ::snprintf( tmp, sizeof( tmp ), "%lld", (long long) ival );
+    this->append_str( tmp, (size_t) n );
+  }
+  /* str[] must be RDB_STR_VAL */
+  void append_strs( const RdbString *str,  size_t n ) {
+    size_t len = 0, i;
+    for ( i = 0; i < n; i++ )
+      len += max_link( str[ i ].s_len );
+    if ( this->reserve( len ) ) {
+      for ( i = 0; i < n; i++ )
+        this->enc.append_link( str[ i ].s, (uint32_t) str[ i ].s_len );
+      this->count += (uint32_t) n;
+    }
+  }
+  void append_ints( const int64_t *ival,  size_t n ) {
+    if ( this->reserve( n * max_link( 20 ) ) ) {
+      for ( size_t i = 0; i < n; i++ )
+        this->append_int( ival[ i ] );
+    }
+  }
+  /* write the end mark and patch the header, return the size */
+  size_t finish( void ) {
+    if ( ! this->reserve( 1 ) )
+      return 0;
+    this->enc.append_end( this->count );
+    return this->failed ? 0 : this->enc.off;
+  }
+};
+
+/* encode a listpack in one pass, the header is patched by finish() */
+struct RdbListPackBuild : public RdbBuildBuf {
+  RdbListPackEncode enc;
+
+  RdbListPackBuild() { this->enc.init(); }
+
+  void start( void ) {
+    this->enc.init( this->buf );
+    this->failed = false;
+  }
+  bool reserve( size_t len ) {
+    if ( ! this->RdbBuildBuf::reserve( this->enc.off, len ) )
+      return false;
+    this->enc.p = this->buf;
+    return true;
+  }
+  /* next is at most 5 bytes (9 for a 64 bit int), back at most 5 bytes */
+  static size_t max_link( size_t sz ) { return 10 + sz; }
+  static const size_t MAX_INT_LINK = 14;
+
+  void append_str( const void *s,  size_t len ) {
+    if ( this->reserve( max_link( len ) ) )
+      this->enc.append_link( s, (uint32_t) len );
+  }
+  void append_int( int64_t ival ) {
+    if ( this->reserve( MAX_INT_LINK ) )
+      this->enc.append_immediate_int( ival );
+  }
+  /* str[] must be RDB_STR_VAL */
+  void append_strs( const RdbString *str,  size_t n ) {
+    size_t len = 0, i;
+    for ( i = 0; i < n; i++ )
+      len += max_link( str[ i ].s_len );
+    if ( this->reserve( len ) ) {
+      for ( i = 0; i < n; i++ )
+        this->enc.append_link( str[ i ].s, (uint32_t) str[ i ].s_len );
+    }
+  }
+  void append_ints( const int64_t *ival,  size_t n ) {
+    if ( this->reserve( n * MAX_INT_LINK ) ) {
+      for ( size_t i = 0; i < n; i++ )
+        this->enc.append_immediate_int( ival[ i ] );
+    }
+  }
+  /* write the end mark and patch the header, return the size */
+  size_t finish( void ) {
+    if ( ! this->reserve( 1 ) )
+      return 0;
+    this->enc.append_end();
+    return this->failed ? 0 : this->enc.off;
+  }
+};
+
+/* same rules as redis string2ll(), only canonical integers are converted */
+bool str_to_int( const char *s,  size_t len,  int64_t &ival ) noexcept;
+/* the value of a zset score, which may be coded as any type */
+double str_to_double( const RdbString &str ) noexcept;
+
+/* collect the elements of a key as they are decoded, then encode them
+ * into the compact type that a target rdb version loads without converting:
+ *
+ *   ver <  10 : HASH_ZIPLIST, ZSET_ZIPLIST, LIST_QUICKLIST (of ziplists)
+ *   ver >= 10 : HASH_LISTPACK, ZSET_LISTPACK, LIST_QUICKLIST_2 (of listpacks)
+ *
+ * hashes and zsets which are larger than the default max-listpack-entries
+ * or max-listpack-value are left in the hash table / skiplist encoding */
+struct RdbTranscode {
+  RdbString * elem;      /* elements, field/value or member/score pairs */
+  size_t      elem_cnt,  /* count of elem[] used */
+              elem_size, /* count of elem[] allocated */
+              buf_len,   /* encoded body length, without the type */
+              buf_size;  /* size of buf[] allocated */
+  uint8_t   * buf;       /* the encoded body */
+  uint16_t    ver;       /* target rdb version */
+  RdbType     src,       /* type of the source key */
+              type;      /* type of the encoded body */
+  bool        collect,   /* if elements are needed to transcode src */
+              overflow;  /* too large for a compact type, use src */
+  RdbZipBuild      zb;   /* ziplist node, reused */
+  RdbListPackBuild lb;   /* listpack node, reused */
+
+  enum Status {
+    TC_ENCODED = 0, /* buf[] has the body of type */
+    TC_SAME    = 1, /* source encoding is native to target, use it */
+    TC_NOTSUP  = 2  /* source type can't be loaded by target */
+  };
+  static const size_t MAX_COMPACT_ENTRIES = 128, /* max-listpack-entries */
+                      MAX_COMPACT_VALUE   = 64,  /* max-listpack-value */
+                      MAX_NODE_SIZE       = 8192;/* list-max-listpack-size */
+
+  RdbTranscode( uint16_t v = 0 )
+    : elem( 0 ), elem_cnt( 0 ), elem_size( 0 ), buf_len( 0 ), buf_size( 0 ),
+      buf( 0 ), ver( v ), src( RDB_BAD_TYPE ), type( RDB_BAD_TYPE ),
+      collect( false ), overflow( false ) {}
+  ~RdbTranscode() {
+    if ( this->elem != NULL )
+      ::free( this->elem );
+    if ( this->buf != NULL )
+      ::free( this->buf );
+  }
+  /* the type that the target loads natively, or RDB_BAD_TYPE if the
+   * type t is not loadable by the target */
+  static RdbType target_type( RdbType t,  uint16_t ver ) noexcept;
+  /* start collecting the elements of a key with type t */
+  void start( RdbType t ) noexcept;
+  /* append an element, strings reference the decode buffer, which must
+   * be valid until encode() is called */
+  void push( const RdbString &str ) noexcept;
+  /* encode the elements pushed into the target type */
+  Status encode( void ) noexcept;
+  /* helpers for encode() */
+  uint8_t * alloc( size_t len ) noexcept;
+  void sort_zset( void ) noexcept;
+  bool append_blob( const uint8_t *blob,  size_t blob_len ) noexcept;
+  bool append_ziplist( size_t i,  size_t n ) noexcept;
+  bool append_listpack( size_t i,  size_t n ) noexcept;
+  bool append_quicklist( void ) noexcept;
+};
+
 }
 #endif
 #endif
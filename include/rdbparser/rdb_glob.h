@@ -0,0 +1,60 @@
+#ifndef __rdbparser__rdb_glob_h__
+#define __rdbparser__rdb_glob_h__
+
+#ifdef __cplusplus
+namespace rdbparser {
+
+/* match a redis style glob without pcre:
+ *
+ *   *  zero or more chars   ?  any char   [abc] [^a-z]  char class
+ *   \x the char x
+ *
+ * the pattern is compiled into segments separated by stars, each segment
+ * is a list of ops with a fixed length, so the first segment is matched at
+ * the start, the last at the end and the ones in between at the leftmost
+ * position found, the literal ops of a segment are located with memmem() */
+struct RdbGlob {
+  enum { G_LIT = 0, G_ANY = 1, G_SET = 2 };
+  struct Op {
+    uint8_t  code; /* G_LIT, G_ANY, G_SET */
+    uint32_t off,  /* lit[ off ] or set[ off ] */
+             len;  /* count of chars */
+  };
+  struct Seg {
+    uint32_t op,     /* first op of segment */
+             op_cnt, /* count of ops */
+             len,    /* count of chars matched */
+             lit_op, /* first G_LIT op, or op_cnt if none */
+             lit_off;/* char offset of lit_op in the segment */
+  };
+  uint8_t  * lit;         /* literal chars, lower case if ignore_case */
+  uint64_t * set;         /* 256 bit char classes */
+  Op       * op;          /* op[ op_cnt ] */
+  Seg      * seg;         /* seg[ seg_cnt ] */
+  uint32_t   lit_len,     /* bytes used in lit */
+             set_cnt,     /* number of classes */
+             op_cnt,      /* number of ops */
+             seg_cnt,     /* number of segments, stars + 1 */
+             min_len;     /* sum of the segment lengths */
+  bool       ignore_case; /* match any case */
+
+  RdbGlob() : lit( 0 ), set( 0 ), op( 0 ), seg( 0 ), lit_len( 0 ),
+    set_cnt( 0 ), op_cnt( 0 ), seg_cnt( 0 ), min_len( 0 ),
+    ignore_case( false ) {}
+  ~RdbGlob() { this->release(); }
+  void release( void ) noexcept;
+
+  /* compile the glob, false if it is malformed or no memory */
+  bool compile( const char *expr,  size_t expr_len,  bool ign_case ) noexcept;
+  /* return true if the whole of s matches */
+  bool match( const char *s,  size_t len ) const noexcept;
+  /* match seg at s, which has at least seg.len chars */
+  bool match_seg( const Seg &sg,  const uint8_t *s ) const noexcept;
+  /* find the leftmost match of sg in s[ 0 -> len ], or -1 */
+  int64_t find_seg( const Seg &sg,  const uint8_t *s,
+                    size_t len ) const noexcept;
+};
+
+} // namespace
+#endif
+#endif
@@ -0,0 +1,60 @@
+#ifndef __rdbparser__rdb_grep_h__
+#define __rdbparser__rdb_grep_h__
+
+#ifdef __cplusplus
+
+extern "C" {
+  struct pcre2_real_code_8;
+  struct pcre2_real_match_data_8;
+}
+
+namespace rdbparser {
+
+/* print the keys with a string, hash field or value, list element, set or
+ * zset member containing a literal needle or matching a regex, with
+ * show_elem, each matching field, member or list index is printed after
+ * the key, separated by a tab
+ *
+ * when the value is a single blob (string, ziplist, listpack, intset), the
+ * raw bytes are searched with memmem() first, if it is not found, the
+ * value is skipped without decoding, unless the needle could be in an
+ * integer, which the compact encodings don't store as text */
+struct GrepOutput : public RdbOutput {
+  RdbBufptr               & bptr;       /* input, at the value after hdr */
+  const char              * needle;     /* literal to find */
+  size_t                    needle_len; /* length of needle */
+  pcre2_real_code_8       * re;         /* or regex to match */
+  pcre2_real_match_data_8 * md;
+  uint64_t                  key_cnt,    /* keys matched */
+                            elem_cnt,   /* elements matched */
+                            skip_cnt;   /* values skipped by blob search */
+  bool                      show_elem,  /* print the elements matched */
+                            is_blob_ok, /* blob search can reject a value */
+                            key_hit;    /* current key matched */
+
+  GrepOutput( RdbDecode &dec,  RdbBufptr &b ) : RdbOutput( dec ), bptr( b ),
+    needle( 0 ), needle_len( 0 ), re( 0 ), md( 0 ), key_cnt( 0 ),
+    elem_cnt( 0 ), skip_cnt( 0 ), show_elem( false ), is_blob_ok( false ),
+    key_hit( false ) {}
+  ~GrepOutput() noexcept;
+
+  /* search for a literal or a pcre, return false if it fails to compile */
+  bool set_needle( const char *s,  size_t len,  bool is_regex ) noexcept;
+  /* after decode_hdr(), search the raw value, clear dec.is_matched if it
+   * can't match, so that decode_body() skips it */
+  void check_blob( void ) noexcept;
+  bool match( const RdbString &s ) noexcept;
+  void hit( const RdbString *elem,  uint64_t idx ) noexcept;
+
+  virtual void d_start_key( void ) noexcept;
+  virtual void d_string( const RdbString &str ) noexcept;
+  virtual void d_module( const RdbString &str ) noexcept;
+  virtual void d_hash( const RdbHashEntry &h ) noexcept;
+  virtual void d_list( const RdbListElem &l ) noexcept;
+  virtual void d_set( const RdbSetMember &s ) noexcept;
+  virtual void d_zset( const RdbZSetMember &z ) noexcept;
+};
+
+} // namespace
+#endif
+#endif
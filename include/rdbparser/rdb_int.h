@@ -111,13 +111,10 @@ static inline uint64_t s8( uint8_t i ) {
 }
 static inline uint64_t s13( const void *p ) { /* big! */
   const uint8_t * b = (const uint8_t *) p;
-  if ( ( b[ 0 ] & 0x10 ) != 0 ) { /* if sign bit is set */
-    int32_t  top = (int8_t) 16 - (int8_t) ( b[ 0 ] & 0xf ); /* extend */
-    uint32_t neg = ~0;
-    return ( (uint64_t) neg << 32 ) |
-             (uint64_t) ( ( (uint32_t) top << 8 ) | (uint32_t) b[ 1 ] );
-  }
-  return ( ( (uint16_t) b[ 0 ] << 8 ) | b[ 1 ] ) & 0x1fff; /* unsigned */
+  uint32_t        u = ( ( (uint32_t) b[ 0 ] & 0x1f ) << 8 ) | (uint32_t) b[ 1 ];
+  if ( ( u & 0x1000 ) != 0 ) /* if sign bit is set, extend */
+    return (uint64_t) (int64_t) ( (int32_t) u - 0x2000 );
+  return u; /* unsigned */
 }
 
 } // namespace
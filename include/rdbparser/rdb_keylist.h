@@ -0,0 +1,44 @@
+#ifndef __rdbparser__rdb_keylist_h__
+#define __rdbparser__rdb_keylist_h__
+
+#ifdef __cplusplus
+namespace rdbparser {
+
+/* a key loaded from the list, the bytes are in RdbKeyListFilter::keys */
+struct RdbKeyListEntry {
+  uint64_t hash; /* xxh64 of key, zero is an empty slot */
+  size_t   off,  /* offset of key in keys */
+           len;  /* length of key */
+};
+
+/* filter keys by an exact list of names, loaded from a file with one key
+ * per line, the keys are in an open addressing hash table, so matching is
+ * one probe no matter how long the list is, integer keys are matched as
+ * the decimal string */
+struct RdbKeyListFilter : public RdbFilter {
+  char            * keys;        /* the file contents, lines are the keys */
+  RdbKeyListEntry * tab;         /* tab[ mask + 1 ] */
+  size_t            mask,        /* size - 1, a power of 2 */
+                    cnt;         /* count of unique keys */
+  bool              ignore_case, /* keys are lower cased */
+                    invert;      /* invert match, like grep -v */
+
+  RdbKeyListFilter( RdbDecode &dec ) : RdbFilter( dec ), keys( 0 ), tab( 0 ),
+    mask( 0 ), cnt( 0 ), ignore_case( false ), invert( false ) {}
+  ~RdbKeyListFilter() { this->release(); }
+  void release( void ) noexcept;
+
+  /* load the keys in fn, return false and print error if it fails */
+  bool load( const char *fn,  bool ign_case,  bool inv ) noexcept;
+  /* add key at keys[ off ], false if already present */
+  bool insert( size_t off,  size_t len ) noexcept;
+  /* return true if key is in the list */
+  bool find( const char *key,  size_t len ) const noexcept;
+  uint64_t hash( const char *key,  size_t len ) const noexcept;
+  /* return true if key matched */
+  virtual bool match_key( const RdbString &key ) noexcept;
+};
+
+} // namespace
+#endif
+#endif
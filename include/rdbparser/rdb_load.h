@@ -0,0 +1,88 @@
+#ifndef __rdbparser__rdb_load_h__
+#define __rdbparser__rdb_load_h__
+
+#include <rdbparser/rdb_restore.h>
+
+#ifdef __cplusplus
+struct pollfd;
+
+namespace rdbparser {
+
+/* a connection to the server with restores in flight */
+struct RestoreConn {
+  int       fd;        /* socket, nonblocking after connect */
+  uint8_t * sbuf,      /* commands not yet sent */
+          * rbuf,      /* replies not yet parsed */
+          * kbuf;      /* keys in flight: [len(4)][us(8)][key] */
+  size_t    s_off,     /* sbuf[ s_off ] is next to send */
+            s_len,     /* end of sbuf data */
+            s_size,    /* size of sbuf allocated */
+            r_len,     /* end of rbuf data */
+            r_size,    /* size of rbuf allocated */
+            k_off,     /* kbuf[ k_off ] is the oldest key in flight */
+            k_len,     /* end of kbuf data */
+            k_size,    /* size of kbuf allocated */
+            in_flight; /* count of commands without a reply */
+  uint64_t  db;        /* db selected on the connection */
+};                     /* calloc()ed by RestoreLoader::connect() */
+
+/* send restore commands to a server over several pipelined connections,
+ * each with at most window commands in flight, replies are parsed and
+ * errors are reported with the key that caused them */
+struct RestoreLoader : public RestoreSink {
+  RestoreConn * conn;      /* conn[ conn_cnt ] */
+  RestoreConn * cur;       /* connection of the command being written */
+  ::pollfd    * pfd;       /* pfd[ conn_cnt ], for poll_io() */
+  size_t        conn_cnt,  /* number of connections */
+                window,    /* max in flight per connection */
+                win_cur,   /* window adapted to latency, <= window */
+                win_credit,/* replies under max_lat_us since win_cur++ */
+                next;      /* round robin start for choosing a conn */
+  uint64_t      sent_cnt,  /* commands sent */
+                ok_cnt,    /* replies ok */
+                err_cnt,   /* replies which are errors */
+                max_lat_us,/* if not zero, adapt win_cur to this latency */
+                lat_sum,   /* sum of latency of replies, us */
+                win_cut_us;/* last time win_cur was cut */
+  bool          failed,    /* connection error, can't continue */
+                cur_large; /* if cmd is large, send it without batching */
+
+  static const size_t SEND_FLUSH_SIZE = 64 * 1024, /* try send() after */
+                      SEND_WAIT_SIZE  = 1024 * 1024;/* wait for send() */
+
+  RestoreLoader() : conn( 0 ), cur( 0 ), pfd( 0 ), conn_cnt( 0 ), window( 0 ),
+    win_cur( 0 ), win_credit( 0 ), next( 0 ), sent_cnt( 0 ), ok_cnt( 0 ),
+    err_cnt( 0 ), max_lat_us( 0 ), lat_sum( 0 ), win_cut_us( 0 ),
+    failed( false ), cur_large( false ) {}
+  ~RestoreLoader() { this->close(); }
+
+  /* connect to addr, either host:port or a unix socket path, with nconn
+   * connections, return false and print the error if it fails */
+  bool connect( const char *addr,  size_t nconn,  size_t win ) noexcept;
+  void close( void ) noexcept;
+  /* RestoreSink: choose a conn and append to its send buffer */
+  virtual void start_cmd( const RdbString &key,  uint64_t db,
+                          size_t len ) noexcept;
+  virtual void write( const void *p,  size_t len ) noexcept;
+  virtual void end_cmd( const RdbString &key ) noexcept;
+  /* RestoreSink: process replies while waiting for the pacer */
+  virtual void wait( uint64_t us ) noexcept;
+  /* halve win_cur when latency is over max_lat_us, otherwise grow it by
+   * one after a window of replies */
+  void adapt_window( uint64_t lat_us,  uint64_t now_us ) noexcept;
+  /* wait until all commands are sent and replies are received */
+  bool drain( void ) noexcept;
+  /* find a connection with room in the window, waiting if necessary */
+  RestoreConn * get_conn( void ) noexcept;
+  /* poll all connections, send data, read and parse replies */
+  bool poll_io( int timeout_ms ) noexcept;
+  bool send_data( RestoreConn &c ) noexcept;
+  bool recv_data( RestoreConn &c ) noexcept;
+  /* queue a SELECT db on c, its reply is not counted as a key */
+  bool select_db( RestoreConn &c,  uint64_t db ) noexcept;
+  void process_replies( RestoreConn &c ) noexcept;
+};
+
+} // namespace
+#endif
+#endif
@@ -0,0 +1,110 @@
+#ifndef __rdbparser__rdb_memory_h__
+#define __rdbparser__rdb_memory_h__
+
+#include <rdbparser/rdb_prefix.h>
+
+#ifdef __cplusplus
+namespace rdbparser {
+
+/* the memory estimated for the keys with a prefix */
+struct RdbMemPrefix {
+  uint64_t keys, /* keys with prefix */
+           mem,  /* estimated memory of keys */
+           enc;  /* encoded bytes of keys */
+  size_t   idx;  /* index of prefix in RdbPrefixTable */
+};
+
+/* estimate the memory used by each key when loaded into redis, on a 64 bit
+ * server with jemalloc and the default encoding limits, the key is counted
+ * in the keyspace dict with the expire, and the value by the encoding that
+ * the server would use, the compact types in the rdb (ziplist, listpack,
+ * intset) stay compact, the others are converted when within the limits,
+ * either printed for each key or summed by prefix */
+struct RdbMemOutput : public RdbOutput {
+  /* the encodings of a value in memory */
+  enum MemEnc {
+    ENC_INT = 0, ENC_EMBSTR, ENC_RAW, ENC_LISTPACK, ENC_QUICKLIST, ENC_INTSET,
+    ENC_HASHTABLE, ENC_SKIPLIST, ENC_STREAM, ENC_MODULE
+  };
+  /* default limits from redis.conf */
+  static const uint64_t HASH_MAX_ENTRIES = 128,   /* hash-max-listpack-* */
+                        HASH_MAX_VALUE   = 64,
+                        SET_MAX_INTSET   = 512,   /* set-max-intset-entries */
+                        SET_MAX_ENTRIES  = 128,   /* set-max-listpack-* */
+                        SET_MAX_VALUE    = 64,
+                        ZSET_MAX_ENTRIES = 128,   /* zset-max-listpack-* */
+                        ZSET_MAX_VALUE   = 64,
+                        LIST_NODE_SIZE   = 8192,  /* list-max-listpack -2 */
+                        EMBSTR_MAX       = 44,    /* embstr size limit */
+                        SHARED_INTS      = 10000; /* shared integers */
+  RdbBufptr    & bptr;
+  RdbPrefixTable prefix;     /* prefixes, if summed by prefix */
+  RdbMemPrefix * pre;        /* pre[ prefix.cnt ] */
+  size_t         pre_size;   /* size of pre[] */
+  uint64_t       type_off,   /* stream offset of type of current key */
+                 elems,      /* elements of the current key */
+                 lp_bytes,   /* listpack entries bytes */
+                 sds_bytes,  /* sds allocs of the elements */
+                 max_len,    /* longest element */
+                 node_bytes, /* bytes in the current list node */
+                 node_mem,   /* allocs of full list nodes */
+                 nodes,      /* count of full list nodes */
+                 str_mem,    /* memory of a string value */
+                 zsl_node,   /* average alloc of a skiplist node */
+                 key_cnt,    /* total keys */
+                 mem_total,  /* total estimated memory */
+                 enc_total;  /* total encoded bytes */
+  int64_t        int_min,    /* range of ints, for the intset width */
+                 int_max;
+  MemEnc         str_enc;    /* encoding of a string value */
+  bool           all_int,    /* all elements are integers */
+                 failed;     /* prefix alloc failed */
+
+  RdbMemOutput( RdbDecode &dec,  RdbBufptr &b ) noexcept;
+  ~RdbMemOutput() noexcept;
+  /* offset in the main buffer, when a value is unzipped the bptr is in the
+   * unzipped buffer until the end of the key */
+  uint64_t stream_offset( void ) const {
+    return this->bptr.start_offset + ( this->bptr.sav != NULL ?
+           this->bptr.sav_offset : this->bptr.offset );
+  }
+  /* sum by prefix up to d delimiters c, instead of printing each key */
+  bool set_prefix( char c,  size_t d ) noexcept;
+  /* jemalloc size class of n bytes */
+  static uint64_t alloc_size( uint64_t n ) noexcept;
+  /* alloc of a sds string with len bytes */
+  static uint64_t sds_size( uint64_t len ) noexcept;
+  /* alloc of a dict with n entries, not including the keys and values */
+  static uint64_t dict_size( uint64_t n ) noexcept;
+  /* bytes of an element in a listpack */
+  static uint64_t lp_entry_size( const RdbString &s ) noexcept;
+  /* length of s, as stored in a sds, integers are formatted */
+  static uint64_t str_len( const RdbString &s ) noexcept;
+  /* if s is an integer, set ival */
+  static bool str_int( const RdbString &s,  int64_t &ival ) noexcept;
+  static const char *enc_name( MemEnc enc ) noexcept;
+  /* add an element to the listpack size, and to the sds size if is_sds */
+  void add_elem( const RdbString &s,  bool is_sds ) noexcept;
+  /* decide the encoding of the current key and the memory used */
+  uint64_t value_mem( uint64_t enc_bytes,  MemEnc &enc ) noexcept;
+  uint64_t key_mem( void ) const noexcept;
+  /* add mem of the current key to the prefix */
+  void add_prefix( uint64_t mem,  uint64_t enc_bytes ) noexcept;
+  void print_prefix( void ) noexcept;
+
+  virtual void d_finish( bool success ) noexcept;
+  virtual void d_start_type( RdbType t ) noexcept;
+  virtual void d_start_key( void ) noexcept;
+  virtual void d_end_key( void ) noexcept;
+  virtual void d_string( const RdbString &str ) noexcept;
+  virtual void d_module( const RdbString &str ) noexcept;
+  virtual void d_hash( const RdbHashEntry &h ) noexcept;
+  virtual void d_list( const RdbListElem &l ) noexcept;
+  virtual void d_set( const RdbSetMember &s ) noexcept;
+  virtual void d_zset( const RdbZSetMember &z ) noexcept;
+  virtual void d_stream_entry( const RdbStreamEntry &entry ) noexcept;
+};
+
+} // namespace
+#endif
+#endif
@@ -1,6 +1,8 @@
 #ifndef __rdbparser__rdb_pcre_h__
 #define __rdbparser__rdb_pcre_h__
 
+#include <rdbparser/rdb_glob.h>
+
 #ifdef __cplusplus
 
 extern "C" {
@@ -10,20 +12,57 @@ extern "C" {
 
 namespace rdbparser {
 
-/* filter keys by pcre */
+/* filter keys by a literal name, a glob matched by RdbGlob, or a pcre of
+ * several patterns or an alternation when built with RDB_USE_PCRE, without
+ * it the patterns are a list of globs */
 struct PcreFilter : public RdbFilter {
   char                      name[ 40 ];  /* if expr is simple string match */
   size_t                    name_len;    /* len of name to match */
   pcre2_real_code_8       * re;          /* pcre regex compiled */
   pcre2_real_match_data_8 * md;          /* pcre match context  */
+  RdbGlob                   glob;        /* glob matched without pcre */
+  RdbGlob                ** glob_alt;    /* without pcre, any glob matches */
+  size_t                    glob_cnt;    /* count of glob_alt[] */
+  uint8_t                 * alt;         /* alternation of add_filter_expr() */
+  size_t                    alt_len,     /* bytes used in alt */
+                            alt_size,    /* size of alt */
+                            alt_cnt;     /* count of exprs in alt */
   bool                      ignore_case, /* like grep -i */
-                            invert;      /* invert match, like grep -v */
+                            invert,      /* invert match, like grep -v */
+                            is_jit,      /* re is jit compiled */
+                            is_glob;     /* use glob instead of re */
 
   PcreFilter( RdbDecode &dec ) : RdbFilter( dec ), name_len( 0 ), re( 0 ),
-                             md( 0 ), ignore_case( false ), invert( false ) {}
+    md( 0 ), glob_alt( 0 ), glob_cnt( 0 ), alt( 0 ), alt_len( 0 ), alt_size( 0 ), alt_cnt( 0 ),
+    ignore_case( false ), invert( false ), is_jit( false ),
+    is_glob( false ) {}
+  ~PcreFilter() {
+    if ( this->alt != NULL )
+      ::free( this->alt );
+    if ( this->glob_alt != NULL ) {
+      for ( size_t i = 0; i < this->glob_cnt; i++ ) {
+        this->glob_alt[ i ]->~RdbGlob();
+        ::free( this->glob_alt[ i ] );
+      }
+      ::free( this->glob_alt );
+    }
+  }
   /* return false if expr failed to compile */
   bool set_filter_expr( const char *expr,  size_t expr_len,
                         bool ign_case,  bool inv ) noexcept;
+  /* add one of several exprs, which are compiled into a single pcre by
+   * compile_filter(), or added to glob_alt without pcre, a key matches if
+   * any of them match */
+  bool add_filter_expr( const char *expr,  size_t expr_len,
+                        bool ign_case ) noexcept;
+  /* add the exprs in file fn, one per line, empty lines are skipped */
+  bool add_filter_file( const char *fn,  bool ign_case ) noexcept;
+  bool compile_filter( bool inv ) noexcept;
+  /* only with RDB_USE_PCRE */
+  bool compile_re( const uint8_t *pat,  size_t len ) noexcept;
+  /* add each glob of expr split at | to glob_alt */
+  bool add_glob_alt( const char *expr,  size_t expr_len,
+                     bool ign_case ) noexcept;
   /* return true if key matched */
   virtual bool match_key( const RdbString &key ) noexcept;
 };
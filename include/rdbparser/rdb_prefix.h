@@ -0,0 +1,138 @@
+#ifndef __rdbparser__rdb_prefix_h__
+#define __rdbparser__rdb_prefix_h__
+
+#ifdef __cplusplus
+namespace rdbparser {
+
+/* a prefix in RdbPrefixTable, the bytes are in RdbPrefixTable::buf */
+struct RdbPrefixEntry {
+  uint64_t hash; /* xxh64 of prefix, not zero */
+  size_t   off,  /* offset of prefix in buf */
+           len;  /* length of prefix */
+};
+
+/* map the prefix of a key, up to depth delimiters, to a dense index, in
+ * the order first seen, the counts of each prefix are kept by the user in
+ * an array indexed the same, the prefixes are in an open addressing table
+ * which maps to the index */
+struct RdbPrefixTable {
+  RdbPrefixEntry * ent;      /* ent[ cnt ] */
+  uint32_t       * tab;      /* index + 1 of ent, tab[ mask + 1 ] */
+  char           * buf;      /* prefix bytes */
+  size_t           cnt,      /* count of prefixes */
+                   ent_size, /* size of ent[] */
+                   mask,     /* size of tab - 1, zero if not used */
+                   buf_len,  /* bytes used in buf */
+                   buf_size, /* size of buf */
+                   depth;    /* prefix is up to depth delimiters */
+  char             delim;    /* delimiter */
+
+  RdbPrefixTable() : ent( 0 ), tab( 0 ), buf( 0 ), cnt( 0 ), ent_size( 0 ),
+    mask( 0 ), buf_len( 0 ), buf_size( 0 ), depth( 0 ), delim( ':' ) {}
+  ~RdbPrefixTable() { this->release(); }
+  void release( void ) noexcept;
+  bool init( char c,  size_t d ) noexcept;
+  /* the prefix of the key, up to and including the depth delimiter, or the
+   * last one found, integer keys and keys without one are the "" prefix */
+  size_t prefix_len( const RdbString &key ) const noexcept;
+  /* find the index of the prefix of key, adding it if new, return false
+   * and print an error if alloc fails */
+  bool find( const RdbString &key,  size_t &idx ) noexcept;
+  bool grow( void ) noexcept;
+  const char *prefix( size_t idx ) const {
+    return &this->buf[ this->ent[ idx ].off ];
+  }
+};
+
+/* a segment of a key prefix, the counts include all the keys below it */
+struct RdbPrefixNode {
+  uint64_t hash,         /* xxh64 of segment, seeded with parent */
+           seg_off,      /* offset of segment in RdbPrefixTree::seg_buf */
+           keys,         /* keys with this prefix */
+           enc_bytes,    /* encoded size of the keys */
+           elems,        /* elements of the keys */
+           expires;      /* keys with an expire */
+  uint32_t parent,       /* index of parent, root is zero */
+           first_child,  /* index of the first child, zero if none */
+           next_sibling, /* index of the next child of the parent */
+           seg_len;      /* length of segment, including the delimiter */
+};
+
+/* keys split on a delimiter into a tree of prefixes, up to max_depth
+ * segments, the last segment of a key, which usually is an id, is not a
+ * prefix, the child of a node is found with a hash of the parent and the
+ * segment, so a node with millions of children is one probe, when the
+ * tree reaches max_nodes, the subtrees with the fewest keys are collapsed
+ * into the remainder of their parent, after that a pruned prefix may be
+ * created again, but with only the keys seen after it was pruned */
+struct RdbPrefixTree {
+  RdbPrefixNode * node;      /* node[ max_nodes ], node[ 0 ] is the root */
+  uint32_t      * tab;       /* hash of nodes, tab[ mask + 1 ] */
+  char          * seg_buf;   /* segment bytes */
+  size_t          node_cnt,  /* nodes used */
+                  max_nodes, /* size of node[] */
+                  mask,      /* size of tab - 1 */
+                  seg_len,   /* bytes used in seg_buf */
+                  seg_size,  /* size of seg_buf */
+                  max_depth; /* segments in tree */
+  uint64_t        collapse_keys, /* largest subtree collapsed */
+                  collapse_cnt;  /* count of collapses */
+  char            delim;     /* delimiter of segments */
+
+  RdbPrefixTree() : node( 0 ), tab( 0 ), seg_buf( 0 ), node_cnt( 0 ),
+    max_nodes( 0 ), mask( 0 ), seg_len( 0 ), seg_size( 0 ), max_depth( 0 ),
+    collapse_keys( 0 ), collapse_cnt( 0 ), delim( ':' ) {}
+  ~RdbPrefixTree() { this->release(); }
+  void release( void ) noexcept;
+
+  /* alloc n nodes, return false and print error if it fails */
+  bool init( char c,  size_t depth,  size_t n ) noexcept;
+  /* add the counts of a key to each prefix of it */
+  bool add( const RdbString &key,  uint64_t enc_bytes,  uint64_t elems,
+            bool has_expire ) noexcept;
+  /* find or create the child segment of parent */
+  uint32_t child( uint32_t parent,  const char *seg,  size_t len ) noexcept;
+  bool add_seg( const char *seg,  size_t len ) noexcept;
+  /* remove the subtrees with the fewest keys, at least half of the nodes */
+  void collapse( void ) noexcept;
+  void rehash( void ) noexcept;
+  /* print the tree, children are ordered by encoded size */
+  void print( void ) noexcept;
+  void print_node( uint32_t i,  size_t depth,  char *path,
+                   size_t path_len ) noexcept;
+};
+
+/* output the prefix tree of the keys matched */
+struct RdbPrefixOutput : public RdbOutput {
+  RdbBufptr   & bptr;
+  RdbPrefixTree tree;
+  uint64_t      type_off, /* stream offset of type of current key */
+                elems;    /* elements of current key */
+  bool          failed;   /* tree add failed */
+
+  RdbPrefixOutput( RdbDecode &dec,  RdbBufptr &b ) noexcept
+    : RdbOutput( dec ), bptr( b ), type_off( 0 ), elems( 0 ),
+      failed( false ) {}
+  /* offset in the main buffer, when a value is unzipped the bptr is in the
+   * unzipped buffer until the end of the key */
+  uint64_t stream_offset( void ) const {
+    return this->bptr.start_offset + ( this->bptr.sav != NULL ?
+           this->bptr.sav_offset : this->bptr.offset );
+  }
+
+  virtual void d_finish( bool success ) noexcept;
+  virtual void d_start_type( RdbType t ) noexcept;
+  virtual void d_start_key( void ) noexcept;
+  virtual void d_end_key( void ) noexcept;
+  virtual void d_string( const RdbString &str ) noexcept;
+  virtual void d_module( const RdbString &str ) noexcept;
+  virtual void d_hash( const RdbHashEntry &h ) noexcept;
+  virtual void d_list( const RdbListElem &l ) noexcept;
+  virtual void d_set( const RdbSetMember &s ) noexcept;
+  virtual void d_zset( const RdbZSetMember &z ) noexcept;
+  virtual void d_stream_entry( const RdbStreamEntry &entry ) noexcept;
+};
+
+} // namespace
+#endif
+#endif
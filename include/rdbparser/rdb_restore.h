@@ -1,38 +1,150 @@
 #ifndef __rdbparser__rdb_restore_h__
 #define __rdbparser__rdb_restore_h__
 
+#include <rdbparser/rdb_encode.h>
+
 #ifdef __cplusplus
 namespace rdbparser {
 
+void sleep_us( uint64_t us ) noexcept;
+
+/* token buckets which limit restores to bytes/s and commands/s */
+struct RestorePacer {
+  double   bytes_per_sec, /* byte rate, 0 is unlimited */
+           cmds_per_sec,  /* command rate, 0 is unlimited */
+           byte_burst,    /* max byte_tokens */
+           cmd_burst,     /* max cmd_tokens */
+           byte_tokens,   /* bytes available, negative is debt */
+           cmd_tokens;    /* commands available */
+  uint64_t last_us;       /* when tokens were last added */
+
+  RestorePacer() : bytes_per_sec( 0 ), cmds_per_sec( 0 ), byte_burst( 0 ),
+    cmd_burst( 0 ), byte_tokens( 0 ), cmd_tokens( 0 ), last_us( 0 ) {}
+
+  bool is_enabled( void ) const {
+    return this->bytes_per_sec > 0 || this->cmds_per_sec > 0;
+  }
+  void set_rate( double bytes_sec,  double cmds_sec ) noexcept;
+  /* return microseconds to wait before a command of len can be sent */
+  uint64_t wait_us( size_t len ) noexcept;
+  /* take the tokens for a command of len */
+  void consume( size_t len ) noexcept;
+  static uint64_t mono_us( void ) noexcept;
+};
+
+/* destination of restore commands other than stdout */
+struct RestoreSink {
+  /* a command for key in db is starting, len is approximate, a sink with
+   * a stream not yet on db writes a SELECT ahead of the command */
+  virtual void start_cmd( const RdbString &key,  uint64_t db,
+                          size_t len ) noexcept = 0;
+  /* append data to the current command */
+  virtual void write( const void *p,  size_t len ) noexcept = 0;
+  /* current command for key is complete */
+  virtual void end_cmd( const RdbString &key ) noexcept = 0;
+  /* wait for pacing, default is to sleep */
+  virtual void wait( uint64_t us ) noexcept;
+  /* format SELECT db into buf, return the length */
+  static size_t select_cmd( char *buf,  size_t len,  uint64_t db ) noexcept;
+};
+
 /* write restore command, key, and data, using:
- * RESTORE key ttl <type><data><ver><crc> [REPLACE] */
+ * RESTORE key ttl <type><data><ver><crc> [REPLACE] [ABSTTL]
+ *   [IDLETIME sec | FREQ f]
+ * keys which are expired are not written
+ * if a target version is set, data is transcoded to the types it loads
+ * natively and <ver> is the target version, otherwise <ver> is 9 */
+struct RdbDelta;
 struct RestoreOutput : public RdbOutput {
-  RdbBufptr & bptr;        /* buf containing data for offsets */
-  uint64_t    ttl_ms,
-              idle;
-  size_t      type_offset; /* where type of data starts */
+  RdbBufptr   & bptr;      /* buf containing data for offsets */
+  RestoreSink * sink;      /* if not null, commands go here, not stdout */
+  RdbDelta    * delta;     /* if not null, only restore keys changed */
+  char        * key_buf;   /* copy of key, it may be lzf decompressed */
+  size_t        key_size;  /* size of key_buf */
+  RdbString     key;       /* key_buf, an int key is in decimal */
+  uint64_t    ttl_ms,      /* absolute expire time, ABSTTL */
+              idle,        /* IDLETIME seconds */
+              db,          /* db of key, from d_dbselect() */
+              out_db,      /* db selected by the stdout stream */
+              expired_cnt, /* count of keys dropped, already expired */
+              notsup_cnt,  /* count of keys dropped, target can't load */
+              same_cnt,    /* count of keys dropped, not changed */
+              del_cnt;     /* count of DEL commands written */
+  size_t      type_offset, /* where type of data starts */
+              splice_min;  /* min body size to vmsplice() */
+  int         splice_fd;   /* if stdout is a pipe and input is mapped */
   bool        use_replace, /* use replace to overwrite key if it exists */
-              is_matched;  /* if matched by filter */
-  uint8_t     freq;
+              is_matched,  /* if matched by filter */
+              has_idle,    /* if idle or freq meta is present for the key */
+              has_freq;
+  uint8_t     freq;        /* FREQ lfu counter */
+  RestorePacer         pace;      /* rate limit, if pace.is_enabled() */
+  RdbTranscode         tc;        /* transcode to target, if tc.ver != 0 */
+  RdbTranscode::Status tc_status; /* TC_ENCODED if tc.buf has the data */
+
+  static const size_t SPLICE_MIN_SIZE = 64 * 1024;
 
   RestoreOutput( RdbDecode &dec,  RdbBufptr &b,  bool repl )
-    : RdbOutput( dec ), bptr( b ), ttl_ms( 0 ), idle( 0 ), type_offset( 0 ),
-      use_replace( repl ), is_matched( false ), freq( 0 ) {}
+    : RdbOutput( dec ), bptr( b ), sink( 0 ), delta( 0 ), key_buf( 0 ),
+      key_size( 0 ), ttl_ms( 0 ),
+      idle( 0 ), db( 0 ), out_db( 0 ), expired_cnt( 0 ), notsup_cnt( 0 ), same_cnt( 0 ),
+      del_cnt( 0 ), type_offset( 0 ), splice_min( SPLICE_MIN_SIZE ),
+      splice_fd( -1 ), use_replace( repl ), is_matched( false ),
+      has_idle( false ), has_freq( false ), freq( 0 ),
+      tc_status( RdbTranscode::TC_SAME ) {}
+  ~RestoreOutput() {
+    if ( this->key_buf != NULL )
+      ::free( this->key_buf );
+  }
 
   virtual void d_idle( uint64_t i ) noexcept;
   virtual void d_freq( uint8_t f ) noexcept;
   virtual void d_expired_ms( uint64_t ms ) noexcept;
+  virtual void d_expired( uint32_t sec ) noexcept;
+  virtual void d_dbselect( uint32_t db ) noexcept;
   virtual void d_start_type( RdbType ) noexcept;
   virtual void d_start_key( void ) noexcept;
+  virtual void d_end_key( void ) noexcept;
+  virtual void d_hash( const RdbHashEntry &h ) noexcept;
+  virtual void d_list( const RdbListElem &l ) noexcept;
+  virtual void d_zset( const RdbZSetMember &z ) noexcept;
 
   void reset_state( void ) {
     this->is_matched = false;
     this->ttl_ms     = 0;
     this->idle       = 0;
     this->freq       = 0;
+    this->has_idle   = false;
+    this->has_freq   = false;
+    this->tc_status  = RdbTranscode::TC_SAME;
   }
+  /* transcode data for ver, must be 9 or greater, 0 is no transcoding */
+  bool set_target_version( uint16_t ver ) noexcept;
+  /* wall clock used to drop expired keys */
+  static uint64_t current_time_ms( void ) noexcept;
   /* at end of key data, call this to write restore command to stdout */
   void write_restore_cmd( void ) noexcept;
+  /* write DEL key in db, used by delta for keys removed */
+  void write_del( const RdbString &key,  uint64_t db ) noexcept;
+  /* start a command for key in db, SELECT db first if it is not current */
+  void start_cmd( const RdbString &key,  uint64_t db,  size_t len ) noexcept;
+  /* if fd is a pipe, large bodies are vmsplice()d from the mapped input
+   * instead of copied through stdout, the input must stay mapped and
+   * unmodified until the reader consumes it, returns true if enabled */
+  bool init_splice( int fd ) noexcept;
+  /* wait until the pacer allows a command of len to be written */
+  void wait_pace( size_t len ) noexcept;
+  /* write body data to stdout, either spliced or copied */
+  void write_body( const uint8_t *b,  size_t len ) noexcept;
+  /* write command data to sink or stdout */
+  void put( const void *p,  size_t len ) noexcept {
+    if ( this->sink != NULL )
+      this->sink->write( p, len );
+    else
+      fwrite( p, 1, len, stdout );
+  }
+  /* write an integer as a bulk string argument: $len\r\n<int>\r\n */
+  void put_uint_arg( uint64_t val ) noexcept;
 };
 
 } // namespace
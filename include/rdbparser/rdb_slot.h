@@ -0,0 +1,69 @@
+#ifndef __rdbparser__rdb_slot_h__
+#define __rdbparser__rdb_slot_h__
+
+#include <rdbparser/rdb_restore.h>
+
+#ifdef __cplusplus
+namespace rdbparser {
+
+/* crc16 xmodem, used by redis cluster for key hash slots */
+uint16_t crc16_xmodem( uint16_t crc,  const void *buf,  size_t len ) noexcept;
+
+static const uint16_t RDB_CLUSTER_SLOTS = 16384;
+
+/* hash slot of key, if the key has a non-empty {tag}, only tag is hashed */
+uint16_t key_hash_slot( const void *key,  size_t len ) noexcept;
+/* same, integer keys are hashed as the decimal string */
+uint16_t key_hash_slot( const RdbString &key ) noexcept;
+
+/* map each cluster slot to one of a set of named outputs */
+struct RdbSlotMap {
+  uint16_t idx[ RDB_CLUSTER_SLOTS ]; /* slot -> output index */
+  char  ** name;                     /* name[ out_cnt ] of each output */
+  size_t   out_cnt;                  /* number of outputs */
+
+  RdbSlotMap() : name( 0 ), out_cnt( 0 ) {}
+  ~RdbSlotMap() { this->release(); }
+  void release( void ) noexcept;
+
+  /* split the slots into n equal ranges, named "start-end" */
+  bool split( size_t n ) noexcept;
+  /* load a map from a file with lines of: start[-end] name
+   * ranges with the same name go to the same output, all slots must be
+   * covered, # starts a comment, return false and print error on failure */
+  bool load( const char *fn ) noexcept;
+  /* find or add the output for name */
+  bool add_name( const char *nm,  size_t len,  uint16_t &i ) noexcept;
+
+  uint16_t key_output( const RdbString &key ) const {
+    return this->idx[ key_hash_slot( key ) ];
+  }
+};
+
+/* write restore commands to one file for each output of a slot map,
+ * files are named prefix.name.resp */
+struct RestoreSlotSplit : public RestoreSink {
+  RdbSlotMap & map;
+  FILE      ** fp;        /* fp[ map.out_cnt ] */
+  FILE       * cur;       /* file of the command being written */
+  uint64_t   * key_cnt,   /* count of keys written to each file */
+             * db;        /* db selected in each file */
+
+  RestoreSlotSplit( RdbSlotMap &m ) : map( m ), fp( 0 ), cur( 0 ),
+                                      key_cnt( 0 ), db( 0 ) {}
+  ~RestoreSlotSplit() { this->close(); }
+
+  /* create the files, return false and print error if it fails */
+  bool open( const char *prefix ) noexcept;
+  bool close( void ) noexcept;
+
+  /* RestoreSink */
+  virtual void start_cmd( const RdbString &key,  uint64_t db,
+                          size_t len ) noexcept;
+  virtual void write( const void *p,  size_t len ) noexcept;
+  virtual void end_cmd( const RdbString &key ) noexcept;
+};
+
+} // namespace
+#endif
+#endif
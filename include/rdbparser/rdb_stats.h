@@ -0,0 +1,153 @@
+#ifndef __rdbparser__rdb_stats_h__
+#define __rdbparser__rdb_stats_h__
+
+#ifdef __cplusplus
+namespace rdbparser {
+
+/* pass a deterministic sample of keys, either those with a key hash under
+ * rate, which selects the same keys on each run and in each snapshot, or
+ * every nth key, the others are skipped without decoding, next is the
+ * other filters, which select the population that is sampled */
+struct RdbSampleFilter : public RdbFilter {
+  uint64_t    threshold, /* xxh64( key ) <= threshold is sampled */
+              every,     /* or each nth key, if not zero */
+              key_cnt;   /* count of keys in the population */
+  RdbFilter * next;      /* key filter, if not null */
+  bool        in_pop;    /* the last key passed next */
+
+  RdbSampleFilter( RdbDecode &dec ) : RdbFilter( dec ),
+    threshold( ~(uint64_t) 0 ), every( 0 ), key_cnt( 0 ), next( 0 ),
+    in_pop( false ) {}
+  /* rate is 0 < rate <= 1, return false if out of range */
+  bool set_rate( double rate ) noexcept;
+  void set_every( uint64_t n ) { this->every = ( n == 0 ? 1 : n ); }
+  virtual bool match_key( const RdbString &key ) noexcept;
+};
+
+/* counts of one type class, the first are exact, from the header of every
+ * key, the s_ counts are from the keys decoded, which may be a sample */
+struct RdbTypeStats {
+  uint64_t keys,       /* keys of this type */
+           expires,    /* keys with an expire */
+           enc_bytes,  /* size of the encoded type, key and value */
+           s_keys,     /* keys decoded */
+           s_elems,    /* elements of keys decoded */
+           s_bytes,    /* bytes in the elements of keys decoded */
+           max_elems,  /* largest element count */
+           max_bytes;  /* largest element bytes */
+  double   s_elems_sq, /* sums of squares for the variance */
+           s_bytes_sq;
+};
+
+/* an estimate of a total from a sample, with a 95% interval */
+struct RdbEstimate {
+  double total, /* estimated total */
+         err;   /* +/- at 95% confidence */
+  /* sum and sum_sq of n sampled items out of N */
+  void compute( double sum,  double sum_sq,  uint64_t n,
+                uint64_t N ) noexcept;
+};
+
+/* a key in a top-k heap, the key is cut to fit, so memory is fixed */
+struct RdbTopEntry {
+  static const size_t KEY_MAX = 128;
+  uint64_t val,            /* value ranked, inverted when is_min */
+           db;             /* db of key */
+  size_t   key_len;        /* length of the whole key */
+  char     key[ KEY_MAX ]; /* first KEY_MAX bytes of key */
+};
+
+/* the k keys with the largest values, or smallest when is_min, kept in a
+ * min heap of k entries, so each key not in the top is one compare */
+struct RdbTopK {
+  RdbTopEntry * heap;   /* heap[ k ], heap[ 0 ] is the smallest */
+  size_t        cnt,    /* entries used */
+                k;      /* size of heap */
+  bool          is_min; /* keep the smallest instead */
+
+  RdbTopK() : heap( 0 ), cnt( 0 ), k( 0 ), is_min( false ) {}
+  ~RdbTopK() {
+    if ( this->heap != NULL )
+      ::free( this->heap );
+  }
+  bool init( size_t n,  bool min ) noexcept;
+  /* add key if it is in the top k */
+  void add( uint64_t val,  uint64_t db,  const RdbString &key ) noexcept {
+    if ( this->is_min )
+      val = ~val;
+    if ( this->cnt < this->k || ( this->k > 0 && val > this->heap[ 0 ].val ) )
+      this->push( val, db, key );
+  }
+  void push( uint64_t val,  uint64_t db,  const RdbString &key ) noexcept;
+  void sift_down( size_t i ) noexcept;
+  /* sort the entries largest first (or smallest when is_min), after this
+   * the heap order is lost */
+  void sort( void ) noexcept;
+  uint64_t value( size_t i ) const {
+    return this->is_min ? ~this->heap[ i ].val : this->heap[ i ].val;
+  }
+};
+
+/* keyspace statistics by type: key count, ttl coverage, encoded size,
+ * elements and element bytes, with a histogram of the encoded key sizes,
+ * and optionally the top k keys by size and idle or freq, printed by
+ * d_finish(),
+ * the key counts, expires and sizes come from the header and are exact,
+ * when the keys are sampled, the totals of the decoded counts are
+ * extrapolated from the keys of each type decoded */
+struct RdbStatsOutput : public RdbOutput {
+  static const int TYPE_CLASSES = 8; /* rdb_type_class() + unknown */
+  RdbBufptr       & bptr;
+  RdbSampleFilter * sample;           /* if keys are sampled */
+  RdbTypeStats      type[ TYPE_CLASSES ];
+  RdbTopK           top_bytes[ TYPE_CLASSES ], /* largest encoded */
+                    top_elems[ TYPE_CLASSES ], /* most elements */
+                    hot_idle,   /* least idle */
+                    cold_idle,  /* most idle */
+                    hot_freq,   /* highest freq */
+                    cold_freq;  /* lowest freq */
+  size_t            top_k;      /* size of top heaps, zero if not used */
+  uint64_t          size_hist[ 64 ],  /* log2 of encoded size of keys */
+                    type_off,   /* stream offset of type of current key */
+                    elems,      /* elements of current key */
+                    bytes,      /* element bytes of current key */
+                    key_cnt,    /* all keys counted */
+                    expired_cnt,/* keys already expired */
+                    now_ms;     /* time for expired */
+  int               cls;        /* type class of current key */
+  bool              is_decoded; /* current key passed the filter */
+
+  RdbStatsOutput( RdbDecode &dec,  RdbBufptr &b ) noexcept;
+  /* offset in the main buffer, when a value is unzipped the bptr is in the
+   * unzipped buffer until the end of the key */
+  uint64_t stream_offset( void ) const {
+    return this->bptr.start_offset + ( this->bptr.sav != NULL ?
+           this->bptr.sav_offset : this->bptr.offset );
+  }
+  static uint64_t str_size( const RdbString &s ) noexcept;
+  /* after the body is decoded or skipped, count the current key, if it
+   * is in the population, which is the keys matched, or the keys matched
+   * before sampling, called before the lzf allocs are freed */
+  void end_key( void ) noexcept;
+  /* keep the top k keys by size, elements, idle and freq */
+  bool set_top( size_t k ) noexcept;
+  /* print the stats */
+  void print( void ) noexcept;
+  void print_top( RdbTopK &top,  const char *title,
+                  const char *val_name ) noexcept;
+
+  virtual void d_finish( bool success ) noexcept;
+  virtual void d_start_type( RdbType t ) noexcept;
+  virtual void d_start_key( void ) noexcept;
+  virtual void d_string( const RdbString &str ) noexcept;
+  virtual void d_module( const RdbString &str ) noexcept;
+  virtual void d_hash( const RdbHashEntry &h ) noexcept;
+  virtual void d_list( const RdbListElem &l ) noexcept;
+  virtual void d_set( const RdbSetMember &s ) noexcept;
+  virtual void d_zset( const RdbZSetMember &z ) noexcept;
+  virtual void d_stream_entry( const RdbStreamEntry &entry ) noexcept;
+};
+
+} // namespace
+#endif
+#endif
@@ -0,0 +1,72 @@
+#ifndef __rdbparser__rdb_ttl_h__
+#define __rdbparser__rdb_ttl_h__
+
+#include <rdbparser/rdb_prefix.h>
+
+#ifdef __cplusplus
+namespace rdbparser {
+
+/* the time until a key expires */
+enum RdbTtlBucket {
+  TTL_EXPIRED = 0, /* already expired */
+  TTL_1M      = 1, /* < 1 minute */
+  TTL_1H      = 2, /* < 1 hour */
+  TTL_1D      = 3, /* < 1 day */
+  TTL_1W      = 4, /* < 1 week */
+  TTL_30D     = 5, /* < 30 days */
+  TTL_1Y      = 6, /* < 1 year */
+  TTL_MORE    = 7, /* >= 1 year */
+  TTL_NEVER   = 8, /* no expire */
+  TTL_BUCKETS = 9
+};
+
+/* keys and encoded bytes in each bucket */
+struct RdbTtlCount {
+  uint64_t keys[ TTL_BUCKETS ],
+           bytes[ TTL_BUCKETS ];
+  size_t   idx;                 /* index of prefix in RdbPrefixTable */
+
+  uint64_t total_keys( void ) const noexcept;
+  uint64_t total_bytes( void ) const noexcept;
+};
+
+/* a histogram of the time until the keys expire, with the keys and encoded
+ * bytes that would be freed in each bucket, by type and by key prefix, the
+ * values are skipped, only the headers and the sizes are needed */
+struct RdbTtlOutput : public RdbOutput {
+  static const int TYPE_CLASSES = 8; /* rdb_type_class() + unknown */
+  RdbBufptr    & bptr;
+  RdbPrefixTable prefix;
+  RdbTtlCount    total,
+                 type[ TYPE_CLASSES ],
+               * pre;       /* pre[ prefix.cnt ] */
+  size_t         pre_size;  /* size of pre[] */
+  uint64_t       type_off,  /* stream offset of type of current key */
+                 now_ms;    /* time for ttl */
+  int            cls;       /* type class of current key */
+  bool           failed;    /* prefix alloc failed */
+
+  RdbTtlOutput( RdbDecode &dec,  RdbBufptr &b ) noexcept;
+  ~RdbTtlOutput() noexcept;
+  /* offset in the main buffer, when a value is unzipped the bptr is in the
+   * unzipped buffer until the end of the key */
+  uint64_t stream_offset( void ) const {
+    return this->bptr.start_offset + ( this->bptr.sav != NULL ?
+           this->bptr.sav_offset : this->bptr.offset );
+  }
+  static RdbTtlBucket bucket( uint64_t expire_ms,  uint64_t now_ms ) noexcept;
+  /* break down by prefix up to d delimiters c */
+  bool set_prefix( char c,  size_t d ) noexcept;
+  RdbTtlCount *prefix_count( void ) noexcept;
+  void print( void ) noexcept;
+  /* print the keys, bytes, never% and bytes in each bucket */
+  static void print_row( const RdbTtlCount &cnt ) noexcept;
+
+  virtual void d_finish( bool success ) noexcept;
+  virtual void d_start_type( RdbType t ) noexcept;
+  virtual void d_end_key( void ) noexcept;
+};
+
+} // namespace
+#endif
+#endif
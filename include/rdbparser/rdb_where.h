@@ -0,0 +1,61 @@
+#ifndef __rdbparser__rdb_where_h__
+#define __rdbparser__rdb_where_h__
+
+#ifdef __cplusplus
+namespace rdbparser {
+
+/* the fields of a key known before the value is decoded */
+enum RdbWhereField {
+  WHERE_TYPE   = 0, /* string, list, set, zset, hash, stream, module */
+  WHERE_TTL    = 1, /* seconds until expire, relative to now */
+  WHERE_EXPIRE = 2, /* expire time, ms since the epoch */
+  WHERE_DB     = 3, /* db number */
+  WHERE_LEN    = 4, /* length in the header, bytes of a string or a compact
+                       encoding, otherwise count of elements */
+  WHERE_IDLE   = 5, /* idle seconds, if saved with lru */
+  WHERE_FREQ   = 6  /* lfu freq, if saved with lfu */
+};
+
+enum RdbWhereOp {
+  WHERE_EQ = 0, WHERE_NE = 1, WHERE_LT = 2, WHERE_LE = 3, WHERE_GT = 4,
+  WHERE_GE = 5
+};
+
+struct RdbWherePred {
+  RdbWhereField field;
+  RdbWhereOp    op;
+  int64_t       val;     /* number or a type from rdb_type_class() */
+  bool          is_none; /* compare with none, the field is not present */
+};
+
+/* filter keys by predicates on the header of the key:
+ *
+ *   type=hash and ttl<3600 and len>10000 and db=2
+ *
+ * all the predicates must be true, a field which is not present (ttl,
+ * expire, idle, freq) only matches "field=none", the predicates are
+ * evaluated before next, which matches the key name */
+struct RdbWhereFilter : public RdbFilter {
+  static const size_t MAX_PRED = 16;
+  RdbWherePred pred[ MAX_PRED ];
+  size_t       pred_cnt;
+  uint64_t     now_ms;    /* time used for ttl */
+  RdbFilter  * next;      /* key filter, if not null */
+
+  RdbWhereFilter( RdbDecode &dec ) : RdbFilter( dec ), pred_cnt( 0 ),
+                                     now_ms( 0 ), next( 0 ) {}
+  /* parse expr, return false and print an error if it fails */
+  bool parse( const char *expr ) noexcept;
+  /* add a predicate after parse(), return false and print an error if full */
+  bool add_pred( RdbWhereField f,  RdbWhereOp op,  int64_t val ) noexcept;
+  /* the type as a string, list, set, zset, hash, stream or module */
+  static int rdb_type_class( RdbType t ) noexcept;
+  static int type_class( const char *s,  size_t len ) noexcept;
+  bool eval( const RdbWherePred &p ) const noexcept;
+  /* return true if the header and key matched */
+  virtual bool match_key( const RdbString &key ) noexcept;
+};
+
+} // namespace
+#endif
+#endif
@@ -0,0 +1,109 @@
+#ifndef __rdbparser__rdb_write_h__
+#define __rdbparser__rdb_write_h__
+
+#include <rdbparser/rdb_encode.h>
+
+#ifdef __cplusplus
+namespace rdbparser {
+
+/* write a complete rdb file:
+ *
+ *   REDIS00vv [AUX name val]* ( SELECTDB db [RESIZEDB sz exp]
+ *     ( [EXPIRED_MS ms] [IDLE sec | FREQ f] type key value )* )* EOF crc
+ *
+ * a key's meta (expire, idle, freq) is set before the key is written,
+ * hashes, zsets and lists use the compact encodings of the version when
+ * they are small enough (see RdbTranscode), sets of integers use intsets,
+ * strings longer than LZF_MIN_SIZE are lzf compressed when that saves
+ * space, output is buffered and the crc64 is computed as it is flushed */
+struct RdbWriter {
+  FILE       * fp;          /* output */
+  uint8_t    * buf,         /* output buffer */
+             * zbuf;        /* lzf compress buffer */
+  size_t       buf_len,     /* bytes used in buf */
+               buf_size,    /* size of buf */
+               zbuf_size;   /* size of zbuf */
+  uint64_t     crc,         /* crc of bytes flushed */
+               out_bytes,   /* bytes flushed */
+               key_cnt,     /* count of keys written */
+               expire_ms,   /* expire of next key, if not zero */
+               idle;        /* idle of next key, if has_idle */
+  uint16_t     ver;         /* rdb version of file */
+  uint8_t      freq;        /* freq of next key, if has_freq */
+  bool         has_idle,    /* if idle is set for next key */
+               has_freq,    /* if freq is set for next key */
+               compress,    /* if lzf compress strings */
+               own_fp,      /* if fp was opened by open() */
+               failed;      /* an output error occurred */
+  RdbTranscode tc;          /* compact encoder for hash, zset, list */
+
+  static const size_t BUF_SIZE      = 256 * 1024,
+                      LZF_MIN_SIZE  = 20,   /* same as redis */
+                      MAX_INTSET    = 512;  /* set-max-intset-entries */
+  static const uint16_t MIN_VERSION = 9,
+                        MAX_VERSION = 12;
+
+  RdbWriter( uint16_t v = MIN_VERSION ) : fp( 0 ), buf( 0 ), zbuf( 0 ),
+    buf_len( 0 ), buf_size( 0 ), zbuf_size( 0 ), crc( 0 ), out_bytes( 0 ),
+    key_cnt( 0 ), expire_ms( 0 ), idle( 0 ), ver( v ), freq( 0 ),
+    has_idle( false ), has_freq( false ), compress( true ), own_fp( false ),
+    failed( false ), tc( v ) {}
+  ~RdbWriter() { this->close(); }
+
+  /* create file fn and write the header, return false if it fails */
+  bool open( const char *fn ) noexcept;
+  /* use an already open file and write the header */
+  bool open( FILE *f ) noexcept;
+  /* write EOF and crc, flush and close, return false if any write failed */
+  bool finish( void ) noexcept;
+  void close( void ) noexcept;
+
+  /* meta data */
+  bool set_version( uint16_t v ) noexcept;
+  void aux( const char *name,  const char *val ) noexcept;
+  void aux( const char *name,  int64_t val ) noexcept;
+  void select_db( uint64_t db ) noexcept;
+  void resize_db( uint64_t db_size,  uint64_t expires_size ) noexcept;
+  uint64_t offset( void ) const { return this->out_bytes + this->buf_len; }
+  /* meta for the next key written */
+  void set_expire_ms( uint64_t ms ) { this->expire_ms = ms; }
+  void set_idle( uint64_t sec ) {
+    this->idle     = sec;
+    this->has_idle = true;
+  }
+  void set_freq( uint8_t f ) {
+    this->freq     = f;
+    this->has_freq = true;
+  }
+
+  /* keys, collections with no elements are not written */
+  void string( const RdbString &key,  const RdbString &val ) noexcept;
+  void list( const RdbString &key,  const RdbString *elem,
+             size_t cnt ) noexcept;
+  void set( const RdbString &key,  const RdbString *mem,
+            size_t cnt ) noexcept;
+  /* fv[] is field, value, field, value ... cnt is the number of fields */
+  void hash( const RdbString &key,  const RdbString *fv,
+             size_t cnt ) noexcept;
+  /* ms[] is member, score, member, score ... cnt is the number of members */
+  void zset( const RdbString &key,  const RdbString *ms,
+             size_t cnt ) noexcept;
+  /* an already encoded type + key + value, copied from another rdb */
+  void raw_key( const void *p,  size_t len ) noexcept;
+
+  /* encoding */
+  void put( const void *p,  size_t len ) noexcept;
+  void put_byte( uint8_t b ) { this->put( &b, 1 ); }
+  void put_len( uint64_t len ) noexcept;
+  void put_str( const void *p,  size_t len ) noexcept;
+  void put_str( const RdbString &str ) noexcept;
+  void put_int( int64_t ival ) noexcept;
+  void put_meta( void ) noexcept; /* expire, idle, freq of the next key */
+  void put_key_meta( RdbType t,  const RdbString &key ) noexcept;
+  bool put_intset( const RdbString *mem,  size_t cnt ) noexcept;
+  void flush( void ) noexcept;
+};
+
+} // namespace
+#endif
+#endif
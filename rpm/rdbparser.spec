@@ -32,7 +32,7 @@ Manipulate, filter, display, construct Redis RDB files.
 %define _include_gdb_index 1
 
 %build
-make build_dir=./usr %{?_smp_mflags} dist_bins
+make build_dir=./usr USE_PCRE=1 %{?_smp_mflags} dist_bins
 cp -a ./include ./usr/include
 
 %install
@@ -0,0 +1,457 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <new>
+#include <rdbparser/rdb_decode.h>
+#include <rdbparser/rdb_encode.h>
+#include <rdbparser/rdb_write.h>
+#include <rdbparser/rdb_slot.h>
+#include <rdbparser/rdb_copy.h>
+
+using namespace rdbparser;
+
+void
+RdbCopyOutput::release( void ) noexcept
+{
+  if ( this->file != NULL ) {
+    for ( size_t i = 0; i < this->file_cnt; i++ )
+      this->file[ i ].~RdbCopyFile();
+    ::free( this->file );
+  }
+  this->file     = NULL;
+  this->file_cnt = 0;
+}
+
+bool
+RdbCopyOutput::open( void ) noexcept
+{
+  size_t n = ( this->map != NULL ? this->map->out_cnt : 1 );
+  if ( this->is_open )
+    return ! this->failed;
+  this->is_open = true;
+  if ( ! this->dec.is_rdb_file ) {
+    fprintf( stderr, "%s: input is not an rdb file\n", this->fn );
+    this->failed = true;
+    return false;
+  }
+  this->file = (RdbCopyFile *) ::malloc( sizeof( RdbCopyFile ) * n );
+  if ( this->file == NULL ) {
+    ::perror( "malloc" );
+    this->failed = true;
+    return false;
+  }
+  for ( ; this->file_cnt < n; this->file_cnt++ ) {
+    RdbCopyFile & f = *new ( &this->file[ this->file_cnt ] ) RdbCopyFile();
+    size_t len = ::strlen( this->fn ) + 8;
+    if ( this->map != NULL )
+      len += ::strlen( this->map->name[ this->file_cnt ] );
+    if ( (f.fn = (char *) ::malloc( len )) == NULL ) {
+      ::perror( "malloc" );
+      this->failed = true;
+      return false;
+    }
+    if ( this->map != NULL )
+      snprintf( f.fn, len, "%s.%s.rdb", this->fn,
+                this->map->name[ this->file_cnt ] );
+    else
+      ::strcpy( f.fn, this->fn );
+    /* the key records are copied as is, so the version can't change */
+    f.w.ver = this->dec.ver;
+    if ( ! f.w.open( f.fn ) ) {
+      this->failed = true;
+      return false;
+    }
+  }
+  return true;
+}
+
+void
+RdbCopyOutput::copy_key( void ) noexcept
+{
+  uint64_t end = this->stream_offset();
+  if ( this->is_matched && this->open() ) {
+    RdbCopyFile & f = this->file[ this->cur ];
+    /* the record is behind the current position in the input */
+    size_t len = (size_t) ( end - this->rec_start );
+    if ( ! f.db_open ) {
+      f.w.select_db( this->db );
+      /* the counts are the same when every key is copied */
+      if ( this->has_resize && this->map == NULL && this->dec.filter == NULL )
+        f.w.resize_db( this->db_size, this->db_expires );
+      f.db_open = true;
+    }
+    f.w.raw_key( this->bptr.buf - len, len );
+    f.copy_cnt++;
+    this->copy_cnt++;
+  }
+  this->rec_start  = end;
+  this->has_expire = false;
+  this->is_matched = false;
+}
+
+void
+RdbCopyOutput::d_finish( bool success ) noexcept
+{
+  if ( ! success ) {
+    this->release();
+    return;
+  }
+  if ( this->open() ) {
+    for ( size_t i = 0; i < this->file_cnt; i++ ) {
+      if ( ! this->file[ i ].w.finish() )
+        this->failed = true;
+    }
+  }
+}
+
+void
+RdbCopyOutput::d_aux( const RdbString &var,  const RdbString &val ) noexcept
+{
+  if ( this->open() ) {
+    for ( size_t i = 0; i < this->file_cnt; i++ ) {
+      RdbWriter & w = this->file[ i ].w;
+      w.put_byte( RDB_AUX );
+      w.put_str( var );
+      w.put_str( val );
+    }
+  }
+  this->rec_start = this->stream_offset();
+}
+
+void
+RdbCopyOutput::d_dbresize( uint64_t i,  uint64_t j ) noexcept
+{
+  /* written when the db is selected in the output */
+  this->db_size    = i;
+  this->db_expires = j;
+  this->has_resize = true;
+  this->rec_start  = this->stream_offset();
+}
+
+void RdbCopyOutput::d_expired_ms( uint64_t ) noexcept { this->has_expire = true; }
+void RdbCopyOutput::d_expired( uint32_t ) noexcept { this->has_expire = true; }
+
+void
+RdbCopyOutput::d_dbselect( uint32_t n ) noexcept
+{
+  for ( size_t i = 0; i < this->file_cnt; i++ )
+    this->file[ i ].db_open = false;
+  this->db         = n;
+  this->has_resize = false;
+  this->rec_start  = this->stream_offset();
+}
+
+void
+RdbCopyOutput::d_start_type( RdbType ) noexcept
+{
+  this->is_matched = false; /* is_matched set when d_start_key() called */
+}
+
+void
+RdbCopyOutput::d_start_key( void ) noexcept
+{
+  this->is_matched = true;
+  /* the key may be lzf decompressed and is released before copy_key() */
+  if ( this->map != NULL )
+    this->cur = this->map->key_output( this->dec.key );
+}
+
+uint64_t
+RdbKeySet::hash( const char *key,  size_t len,  uint64_t db ) noexcept
+{
+  uint64_t h = jones_crc64( 0, key, len );
+  h ^= ( db + 1 ) * (uint64_t) 0x9e3779b97f4a7c15ULL;
+  return ( h == 0 ? 1 : h );
+}
+
+bool
+RdbKeySet::grow( void ) noexcept
+{
+  size_t size = ( this->mask == 0 ? 1024 : ( this->mask + 1 ) * 2 );
+  RdbKeySetEntry * t =
+    (RdbKeySetEntry *) ::calloc( size, sizeof( RdbKeySetEntry ) );
+  if ( t == NULL )
+    return false;
+  if ( this->tab != NULL ) {
+    for ( size_t i = 0; i <= this->mask; i++ ) {
+      const RdbKeySetEntry & e = this->tab[ i ];
+      if ( e.hash != 0 ) {
+        size_t j = (size_t) e.hash & ( size - 1 );
+        while ( t[ j ].hash != 0 )
+          j = ( j + 1 ) & ( size - 1 );
+        t[ j ] = e;
+      }
+    }
+    ::free( this->tab );
+  }
+  this->tab  = t;
+  this->mask = size - 1;
+  return true;
+}
+
+bool
+RdbKeySet::add_key( const char *key,  size_t len ) noexcept
+{
+  if ( this->buf_len + len > this->buf_size ) {
+    size_t sz = ( this->buf_size == 0 ? 64 * 1024 : this->buf_size * 2 );
+    while ( sz < this->buf_len + len )
+      sz *= 2;
+    char * p = (char *) ::realloc( this->buf, sz );
+    if ( p == NULL )
+      return false;
+    this->buf      = p;
+    this->buf_size = sz;
+  }
+  ::memcpy( &this->buf[ this->buf_len ], key, len );
+  this->buf_len += len;
+  return true;
+}
+
+bool
+RdbKeySet::insert( const RdbString &key,  uint64_t db,  bool &failed ) noexcept
+{
+  char         tmp[ 32 ];
+  const char * s;
+  size_t       len;
+
+  if ( key.coding == RDB_STR_VAL ) {
+    s   = key.s;
+    len = key.s_len;
+  }
+  else {
+    len = (size_t) snprintf( tmp, sizeof( tmp ), "%" PRId64, key.ival );
+    s   = tmp;
+  }
+  /* keep the load under 1/2 */
+  if ( this->cnt * 2 >= this->mask ) {
+    if ( ! this->grow() ) {
+      ::perror( "calloc" );
+      failed = true;
+      return false;
+    }
+  }
+  uint64_t h = hash( s, len, db );
+  size_t   j = (size_t) h & this->mask;
+  for (;;) {
+    const RdbKeySetEntry & e = this->tab[ j ];
+    if ( e.hash == 0 )
+      break;
+    if ( e.hash == h && e.db == db && e.len == len &&
+         ::memcmp( &this->buf[ e.off ], s, len ) == 0 )
+      return false;
+    j = ( j + 1 ) & this->mask;
+  }
+  if ( ! this->add_key( s, len ) ) {
+    ::perror( "realloc" );
+    failed = true;
+    return false;
+  }
+  RdbKeySetEntry & e = this->tab[ j ];
+  e.hash = h;
+  e.db   = db;
+  e.off  = this->buf_len - len;
+  e.len  = len;
+  this->cnt++;
+  return true;
+}
+
+bool
+RdbMergeInput::next_hdr( void ) noexcept
+{
+  if ( this->is_eof )
+    return false;
+  RdbErrCode err = this->dec.decode_hdr( this->bptr );
+  if ( err == RDB_OK )
+    return true;
+  this->is_eof = true;
+  if ( err != RDB_EOF_MARK ) {
+    this->merge.err     = err;
+    this->merge.err_idx = this->idx;
+    this->merge.failed  = true;
+  }
+  return false;
+}
+
+bool
+RdbMergeInput::copy_key( void ) noexcept
+{
+  RdbMerge & m = this->merge;
+  RdbErrCode err = this->dec.skip_body( this->bptr );
+  if ( err != RDB_OK ) {
+    m.err     = err;
+    m.err_idx = this->idx;
+    m.failed  = true;
+    return false;
+  }
+  this->dec.key_cnt++;
+  if ( this->bptr.alloced_mem != NULL )
+    this->bptr.free_alloced();
+  uint64_t end = this->stream_offset();
+  if ( ! this->is_dup ) {
+    size_t len = (size_t) ( end - this->rec_start );
+    m.w.raw_key( this->bptr.buf - len, len );
+    this->copy_cnt++;
+  }
+  else {
+    m.dup_cnt++;
+  }
+  this->rec_start  = end;
+  this->has_expire = false;
+  this->is_dup     = false;
+  return ! m.failed;
+}
+
+void
+RdbMergeInput::d_aux( const RdbString &var,  const RdbString &val ) noexcept
+{
+  if ( this->idx == 0 ) {
+    this->merge.w.put_byte( RDB_AUX );
+    this->merge.w.put_str( var );
+    this->merge.w.put_str( val );
+  }
+  this->rec_start = this->stream_offset();
+}
+
+void
+RdbMergeInput::d_dbresize( uint64_t i,  uint64_t j ) noexcept
+{
+  this->db_size    = i;
+  this->db_expires = j;
+  this->rec_start  = this->stream_offset();
+}
+
+void RdbMergeInput::d_expired_ms( uint64_t ) noexcept { this->has_expire = true; }
+void RdbMergeInput::d_expired( uint32_t ) noexcept { this->has_expire = true; }
+
+void
+RdbMergeInput::d_dbselect( uint32_t n ) noexcept
+{
+  this->db         = n;
+  this->db_size    = 0;
+  this->db_expires = 0;
+  this->rec_start  = this->stream_offset();
+}
+
+void
+RdbMergeInput::d_start_key( void ) noexcept
+{
+  RdbMerge & m = this->merge;
+  const RdbString & key = this->dec.key;
+  if ( m.keys.insert( key, this->db, m.failed ) )
+    return;
+  this->is_dup = true;
+  if ( m.policy == MERGE_ERROR && ! m.failed ) {
+    if ( key.coding == RDB_STR_VAL )
+      fprintf( stderr, "%s: key \"%.*s\" db %" PRIu64 " already merged\n",
+               this->fn, (int) key.s_len, key.s, this->db );
+    else
+      fprintf( stderr, "%s: key %" PRId64 " db %" PRIu64 " already merged\n",
+               this->fn, key.ival, this->db );
+    m.failed = true;
+  }
+}
+
+void
+RdbMerge::release( void ) noexcept
+{
+  if ( this->file != NULL ) {
+    for ( size_t i = 0; i < this->file_cnt; i++ ) {
+      this->file[ i ]->~RdbMergeFile();
+      ::free( this->file[ i ] );
+    }
+    ::free( this->file );
+  }
+  this->file     = NULL;
+  this->file_cnt = 0;
+}
+
+bool
+RdbMerge::add_input( const uint8_t *b,  size_t sz,  const char *fn ) noexcept
+{
+  if ( sz < 9 || ::memcmp( b, "REDIS00", 7 ) != 0 ) {
+    fprintf( stderr, "%s: not an rdb file\n", fn );
+    return false;
+  }
+  /* the decoder and input point to each other, so they don't move */
+  RdbMergeFile ** p = (RdbMergeFile **)
+    ::realloc( this->file, sizeof( RdbMergeFile * ) * ( this->file_cnt + 1 ) );
+  void * f = ::malloc( sizeof( RdbMergeFile ) );
+  if ( p != NULL )
+    this->file = p;
+  if ( p == NULL || f == NULL ) {
+    ::perror( "malloc" );
+    if ( f != NULL )
+      ::free( f );
+    return false;
+  }
+  p[ this->file_cnt ] = new ( f ) RdbMergeFile( *this, b, sz, fn,
+                                                this->file_cnt );
+  this->file_cnt++;
+  return true;
+}
+
+bool
+RdbMerge::run( const char *fn ) noexcept
+{
+  uint16_t ver = 0;
+  size_t   i, k;
+  /* the records are copied, use the version of the newest input */
+  for ( i = 0; i < this->file_cnt; i++ ) {
+    const uint8_t * b = this->file[ i ]->in.bptr.buf;
+    uint16_t v = (uint16_t) ( ( b[ 7 ] - '0' ) * 10 + ( b[ 8 ] - '0' ) );
+    if ( v > ver )
+      ver = v;
+  }
+  this->w.ver = ver;
+  if ( ! this->w.open( fn ) )
+    return false;
+  for ( i = 0; i < this->file_cnt; i++ )
+    this->file[ i ]->in.next_hdr();
+
+  while ( ! this->failed ) {
+    uint64_t db    = 0,
+             size  = 0,
+             exp   = 0;
+    bool     found = false;
+    for ( i = 0; i < this->file_cnt; i++ ) {
+      RdbMergeInput & in = this->file[ i ]->in;
+      if ( ! in.is_eof && ( ! found || in.db < db ) ) {
+        db    = in.db;
+        found = true;
+      }
+    }
+    if ( ! found )
+      break;
+    /* the header of the first key of the db is decoded, after RESIZEDB */
+    for ( i = 0; i < this->file_cnt; i++ ) {
+      RdbMergeInput & in = this->file[ i ]->in;
+      if ( ! in.is_eof && in.db == db ) {
+        size += in.db_size;
+        exp  += in.db_expires;
+      }
+    }
+    this->w.select_db( db );
+    if ( size != 0 )
+      this->w.resize_db( size, exp );
+    /* last wins is first wins with the inputs reversed */
+    for ( k = 0; k < this->file_cnt && ! this->failed; k++ ) {
+      i = ( this->policy == MERGE_LAST ? this->file_cnt - 1 - k : k );
+      RdbMergeInput & in = this->file[ i ]->in;
+      while ( ! in.is_eof && in.db == db ) {
+        if ( ! in.copy_key() )
+          break;
+        in.next_hdr();
+      }
+    }
+  }
+  if ( ! this->failed && this->w.finish() )
+    return true;
+  /* don't leave a truncated rdb without the eof and crc */
+  this->w.close();
+  if ( ::remove( fn ) != 0 )
+    ::perror( fn );
+  return false;
+}
@@ -296,6 +296,10 @@ RdbDecode::decode_hdr( RdbBufptr &bptr ) noexcept
   if ( this->is_rdb_file ) {
     const uint8_t * b;
     int cnt;
+    this->expire_ms = 0;
+    this->has_idle  = false;
+    this->has_freq  = false;
+    this->is_expire_sec = false;
     while ( bptr.avail > 0 ) {
       uint8_t next = bptr.buf[ 0 ];
       if ( next >= RDB_MODULE_AUX )
@@ -310,13 +314,15 @@ RdbDecode::decode_hdr( RdbBufptr &bptr ) noexcept
             return err;
           if ( idle.is_lzf || idle.is_enc )
             return RDB_ERR_HDR;
-          this->out->d_idle( idle.len );
+          this->idle     = idle.len;
+          this->has_idle = true;
           break;
         }
         case RDB_FREQ: {      /* 0xf9 - byte */
           if ( (b = bptr.incr( 1 )) == NULL )
             return RDB_ERR_TRUNC;
-          this->out->d_freq( b[ 0 ] );
+          this->freq     = b[ 0 ];
+          this->has_freq = true;
           break;
         }
         case RDB_AUX: {       /* 0xfa - string, string */
@@ -334,7 +340,7 @@ RdbDecode::decode_hdr( RdbBufptr &bptr ) noexcept
               s[ cnt ].set( (char *) b, aux.len );
             }
           }
-          this->out->d_aux( s[ 0 ], s[ 1 ] );
+          this->data_out->d_aux( s[ 0 ], s[ 1 ] );
           break;
         }
         case RDB_DBRESIZE: {  /* 0xfb - length, length */
@@ -347,7 +353,7 @@ RdbDecode::decode_hdr( RdbBufptr &bptr ) noexcept
               return RDB_ERR_HDR;
             rsz[ cnt ] = sz.len;
           }
-          this->out->d_dbresize( rsz[ 0 ], rsz[ 1 ] );
+          this->data_out->d_dbresize( rsz[ 0 ], rsz[ 1 ] );
           break;
         }
         case RDB_EXPIRED_MS: {/* 0xfc - millisecond */
@@ -355,7 +361,7 @@ RdbDecode::decode_hdr( RdbBufptr &bptr ) noexcept
           if ( (b = bptr.incr( 8 )) == NULL )
             return RDB_ERR_TRUNC;
           ms = le<uint64_t>( b );
-          this->out->d_expired_ms( ms );
+          this->expire_ms = ms;
           break;
         }
         case RDB_EXPIRED_SEC: { /* 0xfd - second */
@@ -363,7 +369,8 @@ RdbDecode::decode_hdr( RdbBufptr &bptr ) noexcept
           if ( (b = bptr.incr( 4 )) == NULL )
             return RDB_ERR_TRUNC;
           sec = le<uint32_t>( b );
-          this->out->d_expired( sec );
+          this->expire_ms = (uint64_t) sec * 1000;
+          this->is_expire_sec = true;
           break;
         }
         case RDB_DBSELECT: { /* 0xfe - length */
@@ -372,7 +379,8 @@ RdbDecode::decode_hdr( RdbBufptr &bptr ) noexcept
             return err;
           if ( sz.is_lzf || sz.is_enc )
             return RDB_ERR_HDR;
-          this->out->d_dbselect( (uint32_t) sz.len );
+          this->db = sz.len;
+          this->data_out->d_dbselect( (uint32_t) sz.len );
           break;
         }
         case RDB_EOF:
@@ -412,14 +420,34 @@ RdbDecode::decode_hdr( RdbBufptr &bptr ) noexcept
     if ( err != RDB_OK )
       return err;
   }
+  this->is_matched = ( this->filter == NULL ||
+                       this->filter->match_key( this->key ) );
   /* finally, unzip */
-  if ( this->rlen.is_lzf ) {
+  this->is_unzipped = false;
+  if ( this->rlen.is_lzf && ! this->is_skip && this->is_matched ) {
     if ( ! bptr.decompress( this->rlen.zlen, this->rlen.len ) )
       return RDB_ERR_LZF;
+    this->is_unzipped = true;
   }
   return RDB_OK;
 }
 
+void
+RdbDecode::key_meta( void ) noexcept
+{
+  /* in the order redis writes them */
+  if ( this->expire_ms != 0 ) {
+    if ( this->is_expire_sec )
+      this->out->d_expired( (uint32_t) ( this->expire_ms / 1000 ) );
+    else
+      this->out->d_expired_ms( this->expire_ms );
+  }
+  if ( this->has_idle )
+    this->out->d_idle( this->idle );
+  if ( this->has_freq )
+    this->out->d_freq( this->freq );
+}
+
 bool
 RdbStreamEntry::read_header( RdbListPack &list,  RdbListValue &lval ) noexcept
 {
@@ -517,6 +545,11 @@ RdbDecode::decode_body( RdbBufptr &bptr ) noexcept
 {
   RdbErrCode err;
 
+  /* filtered, skip over it, streams and modules have no lengths to skip */
+  if ( ! this->is_matched && this->type != RDB_STREAM_LISTPACK &&
+       this->type != RDB_STREAM_LISTPACKS_2 && this->type != RDB_MODULE &&
+       this->type != RDB_MODULE_2 )
+    return this->skip_body( bptr );
   /* decode the structures based on the type */
   switch ( this->type ) {
     case RDB_STRING: { /* a single string, the simplest structure */
@@ -608,6 +641,91 @@ RdbDecode::decode_body( RdbBufptr &bptr ) noexcept
   return RDB_ERR_NOTSUP;
 }
 
+RdbErrCode
+RdbDecode::skip_str( RdbBufptr &bptr ) noexcept
+{
+  RdbLength  len;
+  RdbErrCode err = len.decode( bptr );
+  if ( err != RDB_OK )
+    return err;
+  if ( len.is_enc )
+    return RDB_OK;
+  if ( bptr.incr( len.is_lzf ? len.zlen : len.len ) == NULL )
+    return RDB_ERR_TRUNC;
+  return RDB_OK;
+}
+
+RdbErrCode
+RdbDecode::skip_body( RdbBufptr &bptr ) noexcept
+{
+  const uint8_t * b;
+  size_t          cnt;
+  RdbErrCode      err;
+
+  switch ( this->type ) {
+    /* a single string, maybe encoded as a ziplist, listpack or intset */
+    case RDB_STRING:
+    case RDB_HASH_ZIPMAP:
+    case RDB_LIST_ZIPLIST:
+    case RDB_SET_INTSET:
+    case RDB_ZSET_ZIPLIST:
+    case RDB_HASH_ZIPLIST:
+    case RDB_HASH_LISTPACK:
+    case RDB_ZSET_LISTPACK:
+      this->start_key();
+      if ( ! this->rlen.is_enc ) {
+        cnt = ( this->rlen.is_lzf && ! this->is_unzipped ? this->rlen.zlen :
+                this->rlen.len );
+        if ( bptr.incr( cnt ) == NULL )
+          return RDB_ERR_TRUNC;
+      }
+      break;
+
+    case RDB_HASH:           /* field, value strings */
+    case RDB_SET:            /* member strings */
+    case RDB_LIST:           /* element strings */
+    case RDB_LIST_QUICKLIST: /* ziplist strings */
+      this->start_key();
+      cnt = this->rlen.len;
+      if ( this->type == RDB_HASH )
+        cnt *= 2;
+      for ( ; cnt > 0; cnt-- )
+        if ( (err = skip_str( bptr )) != RDB_OK )
+          return err;
+      break;
+
+    case RDB_ZSET:   /* member string, score as string */
+    case RDB_ZSET_2: /* member string, score as binary double */
+      this->start_key();
+      for ( cnt = this->rlen.len; cnt > 0; cnt-- ) {
+        if ( (err = skip_str( bptr )) != RDB_OK )
+          return err;
+        if ( this->type == RDB_ZSET_2 )
+          b = bptr.incr( 8 );
+        else if ( (b = bptr.incr( 1 )) != NULL && b[ 0 ] < 253 )
+          b = bptr.incr( b[ 0 ] );
+        if ( b == NULL )
+          return RDB_ERR_TRUNC;
+      }
+      break;
+
+    case RDB_LIST_QUICKLIST_2: /* container, listpack string */
+      this->start_key();
+      for ( cnt = this->rlen.len; cnt > 0; cnt-- ) {
+        RdbLength container;
+        if ( (err = container.decode( bptr )) != RDB_OK ||
+             (err = skip_str( bptr )) != RDB_OK )
+          return err;
+      }
+      break;
+
+    default:
+      return this->decode_body( bptr );
+  }
+  this->out->d_end_key();
+  return RDB_OK;
+}
+
 RdbErrCode
 RdbDecode::decode_rlen( RdbBufptr &bptr,  RdbString &str ) noexcept
 {
@@ -1384,6 +1502,77 @@ rdbparser::jones_crc64( uint64_t crc, const void *buf, size_t len ) noexcept
 #endif
 }
 
+static const uint64_t XXH_P1 = 0x9e3779b185ebca87ULL,
+                      XXH_P2 = 0xc2b2ae3d27d4eb4fULL,
+                      XXH_P3 = 0x165667b19e3779f9ULL,
+                      XXH_P4 = 0x85ebca77c2b2ae63ULL,
+                      XXH_P5 = 0x27d4eb2f165667c5ULL;
+
+static inline uint64_t xxh_rotl( uint64_t x,  int r ) {
+  return ( x << r ) | ( x >> ( 64 - r ) );
+}
+static inline uint64_t xxh_round( uint64_t acc,  uint64_t in ) {
+  acc += in * XXH_P2;
+  return xxh_rotl( acc, 31 ) * XXH_P1;
+}
+static inline uint64_t xxh_merge( uint64_t acc,  uint64_t v ) {
+  acc ^= xxh_round( 0, v );
+  return acc * XXH_P1 + XXH_P4;
+}
+
+/* xxHash64, 32 bytes per loop, used for comparing values, not stored in
+ * rdb files */
+uint64_t
+rdbparser::xxh64( uint64_t seed,  const void *buf,  size_t len ) noexcept
+{
+  const uint8_t * p   = (const uint8_t *) buf,
+                * end = &p[ len ];
+  uint64_t h;
+
+  if ( len >= 32 ) {
+    uint64_t v1 = seed + XXH_P1 + XXH_P2,
+             v2 = seed + XXH_P2,
+             v3 = seed,
+             v4 = seed - XXH_P1;
+    do {
+      v1 = xxh_round( v1, le<uint64_t>( p ) );
+      v2 = xxh_round( v2, le<uint64_t>( &p[ 8 ] ) );
+      v3 = xxh_round( v3, le<uint64_t>( &p[ 16 ] ) );
+      v4 = xxh_round( v4, le<uint64_t>( &p[ 24 ] ) );
+      p = &p[ 32 ];
+    } while ( p + 32 <= end );
+    h = xxh_rotl( v1, 1 ) + xxh_rotl( v2, 7 ) + xxh_rotl( v3, 12 ) +
+        xxh_rotl( v4, 18 );
+    h = xxh_merge( h, v1 );
+    h = xxh_merge( h, v2 );
+    h = xxh_merge( h, v3 );
+    h = xxh_merge( h, v4 );
+  }
+  else {
+    h = seed + XXH_P5;
+  }
+  h += (uint64_t) len;
+  for ( ; p + 8 <= end; p = &p[ 8 ] ) {
+    h ^= xxh_round( 0, le<uint64_t>( p ) );
+    h  = xxh_rotl( h, 27 ) * XXH_P1 + XXH_P4;
+  }
+  if ( p + 4 <= end ) {
+    h ^= (uint64_t) le<uint32_t>( p ) * XXH_P1;
+    h  = xxh_rotl( h, 23 ) * XXH_P2 + XXH_P3;
+    p  = &p[ 4 ];
+  }
+  for ( ; p < end; p++ ) {
+    h ^= (uint64_t) *p * XXH_P5;
+    h  = xxh_rotl( h, 11 ) * XXH_P1;
+  }
+  h ^= h >> 33;
+  h *= XXH_P2;
+  h ^= h >> 29;
+  h *= XXH_P3;
+  h ^= h >> 32;
+  return h;
+}
+
 /* Test main */
 #if defined(MY_CRC64_TEST)
 #include <stdio.h>
@@ -0,0 +1,533 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <rdbparser/rdb_decode.h>
+#include <rdbparser/rdb_json.h>
+#include <rdbparser/rdb_encode.h>
+#include <rdbparser/rdb_restore.h>
+#include <rdbparser/rdb_diff.h>
+
+using namespace rdbparser;
+
+void
+RdbHashOutput::d_expired_ms( uint64_t ms ) noexcept
+{
+  this->kh.expire_ms = ms;
+}
+
+void
+RdbHashOutput::d_expired( uint32_t sec ) noexcept
+{
+  this->kh.expire_ms = (uint64_t) sec * 1000;
+}
+
+void
+RdbHashOutput::d_dbselect( uint32_t db ) noexcept
+{
+  this->kh.db = db;
+}
+
+void
+RdbHashOutput::d_start_type( RdbType t ) noexcept
+{
+  this->kh.type    = t;
+  this->type_off   = this->stream_offset();
+  this->is_matched = false; /* is_matched set when d_start_key() called */
+}
+
+void
+RdbHashOutput::d_start_key( void ) noexcept
+{
+  const RdbString & key = this->dec.key;
+  char   tmp[ 32 ];
+  const char * s = tmp;
+  size_t len;
+  /* copy the key, it may be in lzf memory released before hash_key() */
+  if ( key.coding == RDB_STR_VAL ) {
+    s   = key.s;
+    len = key.s_len;
+  }
+  else {
+    len = (size_t) snprintf( tmp, sizeof( tmp ), "%" PRId64, key.ival );
+  }
+  if ( len + 1 > this->key_size ) {
+    char * p = (char *) ::realloc( this->key_buf, len + 1 );
+    if ( p == NULL ) {
+      ::perror( "realloc" );
+      return;
+    }
+    this->key_buf  = p;
+    this->key_size = len + 1;
+  }
+  ::memcpy( this->key_buf, s, len );
+  this->kh.key.set( this->key_buf, len );
+  this->kh.key_hash = xxh64( 0, s, len );
+  this->is_matched  = true;
+}
+
+void
+RdbHashOutput::hash_key( void ) noexcept
+{
+  if ( this->is_matched && this->sink != NULL ) {
+    /* the record is behind the current position in the input */
+    size_t len = (size_t) ( this->stream_offset() - this->type_off );
+    this->kh.rec_len  = len;
+    this->kh.val_hash = xxh64( this->kh.expire_ms, this->bptr.buf - len, len );
+    this->sink->key_hash( this->kh );
+  }
+  this->kh.expire_ms = 0;
+  this->is_matched   = false;
+}
+
+RdbErrCode
+rdbparser::hash_rdb_keys( const uint8_t *buf,  size_t len,
+                          RdbHashSink &sink ) noexcept
+{
+  RdbDecode     dec;
+  RdbBufptr     bptr( buf, len );
+  RdbHashOutput out( dec, bptr, &sink );
+  RdbErrCode    err;
+
+  dec.data_out = &out;
+  dec.is_skip  = true;
+  for (;;) {
+    if ( (err = dec.decode_hdr( bptr )) == RDB_OK )
+      err = dec.skip_body( bptr );
+    if ( err != RDB_OK )
+      return ( err == RDB_EOF_MARK ? RDB_OK : err );
+    dec.key_cnt++;
+    if ( bptr.alloced_mem != NULL )
+      bptr.free_alloced();
+    out.hash_key();
+    if ( bptr.avail == 0 )
+      return RDB_OK;
+  }
+}
+
+void
+RdbDiff::release( void ) noexcept
+{
+  for ( int s = 0; s < 2; s++ ) {
+    for ( size_t p = 0; p < DIFF_PARTS; p++ ) {
+      if ( this->part[ s ][ p ] != NULL )
+        ::fclose( this->part[ s ][ p ] );
+      this->part[ s ][ p ] = NULL;
+    }
+  }
+  if ( this->buf != NULL )
+    ::free( this->buf );
+  if ( this->tab != NULL )
+    ::free( this->tab );
+  this->buf      = NULL;
+  this->tab      = NULL;
+  this->buf_len  = 0;
+  this->buf_size = 0;
+  this->tab_mask = 0;
+}
+
+static size_t
+part_index( uint64_t key_hash )
+{
+  return (size_t) ( key_hash >> 58 ) % RdbDiff::DIFF_PARTS;
+}
+
+void
+RdbDiff::key_hash( const RdbKeyHash &kh ) noexcept
+{
+  RdbDiffEntry e;
+  if ( this->failed )
+    return;
+  e.set( kh );
+  if ( this->is_spilled ) {
+    if ( ! this->write_part( this->side, e, kh.key.s ) )
+      this->failed = true;
+  }
+  else if ( this->side == 0 ) {
+    if ( ! this->append( kh ) )
+      this->failed = true;
+    else if ( this->buf_len > this->mem_limit && ! this->spill() )
+      this->failed = true;
+  }
+  else {
+    char c = this->probe( e, kh.key.s );
+    if ( c != '=' )
+      this->print_key( c, e.db, kh.key.s, e.key_len );
+  }
+}
+
+bool
+RdbDiff::append( const RdbKeyHash &kh ) noexcept
+{
+  RdbDiffEntry e;
+  e.set( kh );
+  size_t sz = e.size();
+  if ( this->buf_len + sz > this->buf_size ) {
+    size_t    n = ( this->buf_size == 0 ? 64 * 1024 : this->buf_size * 2 );
+    uint8_t * p;
+    while ( n < this->buf_len + sz )
+      n *= 2;
+    if ( (p = (uint8_t *) ::realloc( this->buf, n )) == NULL ) {
+      ::perror( "realloc" );
+      return false;
+    }
+    this->buf      = p;
+    this->buf_size = n;
+  }
+  uint8_t * p = &this->buf[ this->buf_len ];
+  ::memcpy( p, &e, sizeof( e ) );
+  ::memcpy( &p[ sizeof( e ) ], kh.key.s, e.key_len );
+  this->buf_len += sz;
+  return true;
+}
+
+/* move the old entries to partition files, the rest of old and new go
+ * directly to the files */
+bool
+RdbDiff::spill( void ) noexcept
+{
+  for ( int s = 0; s < 2; s++ ) {
+    for ( size_t p = 0; p < DIFF_PARTS; p++ ) {
+      if ( (this->part[ s ][ p ] = ::tmpfile()) == NULL ) {
+        ::perror( "tmpfile" );
+        return false;
+      }
+    }
+  }
+  this->is_spilled = true;
+  for ( size_t off = 0; off < this->buf_len; ) {
+    const RdbDiffEntry & e = *(const RdbDiffEntry *) &this->buf[ off ];
+    if ( ! this->write_part( 0, e, e.key() ) )
+      return false;
+    off += e.size();
+  }
+  this->buf_len = 0;
+  return true;
+}
+
+bool
+RdbDiffEntry::write( FILE *fp,  const char *key ) const noexcept
+{
+  static const char zero[ 8 ] = { 0 };
+  size_t pad = this->size() - sizeof( *this ) - this->key_len;
+  return ::fwrite( this, sizeof( *this ), 1, fp ) == 1 &&
+         ::fwrite( key, 1, this->key_len, fp ) == this->key_len &&
+         ::fwrite( zero, 1, pad, fp ) == pad;
+}
+
+bool
+RdbDiff::write_part( int s,  const RdbDiffEntry &e,  const char *key ) noexcept
+{
+  if ( ! e.write( this->part[ s ][ part_index( e.key_hash ) ], key ) ) {
+    ::perror( "spill diff" );
+    return false;
+  }
+  return true;
+}
+
+bool
+RdbDiff::load_part( FILE *fp ) noexcept
+{
+  long sz;
+  if ( ::fseek( fp, 0, SEEK_END ) != 0 || (sz = ::ftell( fp )) < 0 ||
+       ::fseek( fp, 0, SEEK_SET ) != 0 ) {
+    ::perror( "load diff" );
+    return false;
+  }
+  if ( (size_t) sz > this->buf_size ) {
+    uint8_t * p = (uint8_t *) ::realloc( this->buf, (size_t) sz );
+    if ( p == NULL ) {
+      ::perror( "realloc" );
+      return false;
+    }
+    this->buf      = p;
+    this->buf_size = (size_t) sz;
+  }
+  this->buf_len = (size_t) sz;
+  if ( sz > 0 && ::fread( this->buf, 1, (size_t) sz, fp ) != (size_t) sz ) {
+    ::perror( "load diff" );
+    return false;
+  }
+  return true;
+}
+
+bool
+RdbDiff::build_tab( void ) noexcept
+{
+  size_t cnt = 0, size = 16, off;
+  for ( off = 0; off < this->buf_len; cnt++ )
+    off += ( (const RdbDiffEntry *) &this->buf[ off ] )->size();
+  while ( size < cnt * 2 )
+    size *= 2;
+  if ( size - 1 != this->tab_mask ) {
+    if ( this->tab != NULL )
+      ::free( this->tab );
+    this->tab_mask = 0;
+    if ( (this->tab = (size_t *) ::malloc( size * sizeof( size_t ) )) == NULL ) {
+      ::perror( "malloc" );
+      return false;
+    }
+    this->tab_mask = size - 1;
+  }
+  ::memset( this->tab, 0, size * sizeof( size_t ) );
+  for ( off = 0; off < this->buf_len; ) {
+    const RdbDiffEntry & e = *(const RdbDiffEntry *) &this->buf[ off ];
+    size_t j = (size_t) e.key_hash & this->tab_mask;
+    while ( this->tab[ j ] != 0 )
+      j = ( j + 1 ) & this->tab_mask;
+    this->tab[ j ] = off + 1;
+    off += e.size();
+  }
+  return true;
+}
+
+char
+RdbDiff::probe( const RdbDiffEntry &e,  const char *key ) noexcept
+{
+  size_t j = (size_t) e.key_hash & this->tab_mask;
+  for ( ; this->tab[ j ] != 0; j = ( j + 1 ) & this->tab_mask ) {
+    RdbDiffEntry & x = *(RdbDiffEntry *) &this->buf[ this->tab[ j ] - 1 ];
+    if ( x.key_hash == e.key_hash && ( x.db & ~DIFF_MATCHED ) == e.db &&
+         x.key_len == e.key_len && ::memcmp( x.key(), key, e.key_len ) == 0 ) {
+      x.db |= DIFF_MATCHED;
+      if ( x.val_hash != e.val_hash ) {
+        this->chg_cnt++;
+        return '~';
+      }
+      this->same_cnt++;
+      return '=';
+    }
+  }
+  this->add_cnt++;
+  return '+';
+}
+
+void
+RdbDiff::print_removed( void ) noexcept
+{
+  for ( size_t off = 0; off < this->buf_len; ) {
+    const RdbDiffEntry & e = *(const RdbDiffEntry *) &this->buf[ off ];
+    if ( ( e.db & DIFF_MATCHED ) == 0 ) {
+      this->rem_cnt++;
+      this->print_key( '-', e.db, e.key(), e.key_len );
+    }
+    off += e.size();
+  }
+}
+
+void
+RdbDiff::print_key( char c,  uint32_t db,  const char *key,
+                    size_t len ) noexcept
+{
+  RdbString s;
+  s.set( key, len );
+  printf( "%c %u ", c, db );
+  print_s( s );
+  printf( "\n" );
+}
+
+void
+RdbDiff::start_new( void ) noexcept
+{
+  this->side = 1;
+  if ( ! this->is_spilled && ! this->build_tab() )
+    this->failed = true;
+}
+
+bool
+RdbDiff::finish( void ) noexcept
+{
+  if ( this->failed )
+    return false;
+  if ( ! this->is_spilled ) {
+    this->print_removed();
+    return true;
+  }
+  /* join each partition, the old in memory, the new streamed */
+  for ( size_t p = 0; p < DIFF_PARTS; p++ ) {
+    FILE * fp = this->part[ 1 ][ p ];
+    char * key = NULL;
+    size_t key_size = 0;
+    RdbDiffEntry e;
+    if ( ! this->load_part( this->part[ 0 ][ p ] ) || ! this->build_tab() ||
+         ::fseek( fp, 0, SEEK_SET ) != 0 )
+      return false;
+    while ( ::fread( &e, sizeof( e ), 1, fp ) == 1 ) {
+      size_t n = e.size() - sizeof( e );
+      if ( n > key_size ) {
+        char * k = (char *) ::realloc( key, n );
+        if ( k == NULL ) {
+          ::perror( "realloc" );
+          ::free( key );
+          return false;
+        }
+        key      = k;
+        key_size = n;
+      }
+      if ( n > 0 && ::fread( key, 1, n, fp ) != n ) {
+        ::perror( "load diff" );
+        ::free( key );
+        return false;
+      }
+      char c = this->probe( e, key );
+      if ( c != '=' )
+        this->print_key( c, e.db, key, e.key_len );
+    }
+    if ( key != NULL )
+      ::free( key );
+    this->print_removed();
+  }
+  return true;
+}
+
+static const char rdb_idx_magic[] = "RDBPIDX2";
+
+bool
+RdbDelta::load_index( const char *fn ) noexcept
+{
+  char   magic[ 8 ];
+  FILE * fp = ::fopen( fn, "rb" );
+  long   sz;
+  if ( fp == NULL ) {
+    ::perror( fn );
+    return false;
+  }
+  if ( ::fread( magic, 1, 8, fp ) != 8 ||
+       ::memcmp( magic, rdb_idx_magic, 8 ) != 0 ) {
+    fprintf( stderr, "%s: not an index file\n", fn );
+    ::fclose( fp );
+    return false;
+  }
+  if ( ::fseek( fp, 0, SEEK_END ) != 0 || (sz = ::ftell( fp )) < 8 ||
+       ::fseek( fp, 8, SEEK_SET ) != 0 ) {
+    ::perror( fn );
+    ::fclose( fp );
+    return false;
+  }
+  size_t len = (size_t) sz - 8;
+  uint8_t * p = (uint8_t *) ::realloc( this->buf, len + 1 );
+  if ( p == NULL ) {
+    ::perror( "realloc" );
+    ::fclose( fp );
+    return false;
+  }
+  this->buf      = p;
+  this->buf_size = len + 1;
+  this->buf_len  = len;
+  if ( ::fread( this->buf, 1, len, fp ) != len ) {
+    ::perror( fn );
+    ::fclose( fp );
+    return false;
+  }
+  ::fclose( fp );
+  /* check that the entries are whole */
+  size_t off = 0;
+  while ( off + sizeof( RdbDiffEntry ) <= len )
+    off += ( (const RdbDiffEntry *) &this->buf[ off ] )->size();
+  if ( off != len ) {
+    fprintf( stderr, "%s: index truncated\n", fn );
+    return false;
+  }
+  return true;
+}
+
+bool
+RdbDelta::open_index( const char *fn ) noexcept
+{
+  if ( (this->idx = ::fopen( fn, "wb" )) == NULL ) {
+    ::perror( fn );
+    return false;
+  }
+  this->idx_fn = fn;
+  if ( ::fwrite( rdb_idx_magic, 1, 8, this->idx ) != 8 ) {
+    ::perror( fn );
+    return false;
+  }
+  return true;
+}
+
+bool
+RdbDelta::check( uint64_t db,  const RdbString &key,  RdbType type,
+                 uint64_t rec_len,  uint64_t val_hash ) noexcept
+{
+  RdbDiffEntry e;
+  char         tmp[ 32 ];
+  const char * s = tmp;
+  size_t       len;
+  if ( key.coding == RDB_STR_VAL ) {
+    s   = key.s;
+    len = key.s_len;
+  }
+  else {
+    len = (size_t) snprintf( tmp, sizeof( tmp ), "%" PRId64, key.ival );
+  }
+  e.key_hash = xxh64( 0, s, len );
+  e.val_hash = val_hash;
+  e.len_type = ( rec_len << 8 ) | (uint8_t) type;
+  e.db       = (uint32_t) db;
+  e.key_len  = (uint32_t) len;
+  if ( this->idx != NULL && ! this->failed ) {
+    if ( ! e.write( this->idx, s ) ) {
+      ::perror( this->idx_fn );
+      this->failed = true;
+    }
+  }
+  return this->probe( e, s ) != '=';
+}
+
+bool
+RdbDelta::finish_delta( void ) noexcept
+{
+  this->print_removed();
+  if ( this->idx != NULL ) {
+    if ( ::fclose( this->idx ) != 0 ) {
+      ::perror( this->idx_fn );
+      this->failed = true;
+    }
+    this->idx = NULL;
+  }
+  return ! this->failed;
+}
+
+void
+RdbDelta::print_key( char c,  uint32_t db,  const char *key,
+                     size_t len ) noexcept
+{
+  if ( c == '-' && this->out != NULL ) {
+    RdbString s;
+    s.set( key, len );
+    this->out->write_del( s, db );
+  }
+}
+
+bool
+RdbFingerprint::start( void ) noexcept
+{
+  if ( this->is_binary && ::fwrite( rdb_idx_magic, 1, 8, stdout ) != 8 ) {
+    ::perror( "fwrite" );
+    this->failed = true;
+  }
+  return ! this->failed;
+}
+
+void
+RdbFingerprint::key_hash( const RdbKeyHash &kh ) noexcept
+{
+  if ( this->failed )
+    return;
+  if ( this->is_binary ) {
+    RdbDiffEntry e;
+    e.set( kh );
+    if ( ! e.write( stdout, kh.key.s ) ) {
+      ::perror( "fwrite" );
+      this->failed = true;
+    }
+    return;
+  }
+  printf( "%" PRIu64 "\t", kh.db );
+  print_s( kh.key );
+  printf( "\t%u\t%" PRIu64 "\t%016" PRIx64 "\n", (uint32_t) kh.type,
+          kh.rec_len, kh.val_hash );
+}
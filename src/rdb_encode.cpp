@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <rdbparser/rdb_decode.h>
+#include <rdbparser/rdb_encode.h>
+
+using namespace rdbparser;
+
+RdbType
+RdbTranscode::target_type( RdbType t,  uint16_t ver ) noexcept
+{
+  switch ( t ) {
+    case RDB_HASH:
+    case RDB_HASH_ZIPMAP:
+    case RDB_HASH_ZIPLIST:
+    case RDB_HASH_LISTPACK:
+      return ver >= 10 ? RDB_HASH_LISTPACK : RDB_HASH_ZIPLIST;
+    case RDB_ZSET:
+    case RDB_ZSET_2:
+    case RDB_ZSET_ZIPLIST:
+    case RDB_ZSET_LISTPACK:
+      return ver >= 10 ? RDB_ZSET_LISTPACK : RDB_ZSET_ZIPLIST;
+    case RDB_LIST:
+    case RDB_LIST_ZIPLIST:
+    case RDB_LIST_QUICKLIST:
+    case RDB_LIST_QUICKLIST_2:
+      return ver >= 10 ? RDB_LIST_QUICKLIST_2 : RDB_LIST_QUICKLIST;
+    case RDB_STREAM_LISTPACKS_2: /* has fields not present in older streams */
+      return ver >= 10 ? t : RDB_BAD_TYPE;
+    default:
+      return t;
+  }
+}
+
+void
+RdbTranscode::start( RdbType t ) noexcept
+{
+  RdbType tt = target_type( t, this->ver );
+  this->src      = t;
+  this->type     = RDB_BAD_TYPE;
+  this->elem_cnt = 0;
+  this->buf_len  = 0;
+  this->overflow = false;
+  this->collect  = ( tt != t && tt != RDB_BAD_TYPE );
+}
+
+static bool
+is_compact_type( RdbType t )
+{
+  switch ( t ) {
+    case RDB_HASH:
+    case RDB_ZSET:
+    case RDB_ZSET_2:
+      return false; /* hash table or skiplist, may be too large */
+    default:
+      return true;
+  }
+}
+
+void
+RdbTranscode::push( const RdbString &str ) noexcept
+{
+  if ( ! this->collect )
+    return;
+  /* a hash table or skiplist which is too large stays that way */
+  if ( ! is_compact_type( this->src ) ) {
+    if ( this->elem_cnt >= MAX_COMPACT_ENTRIES * 2 ||
+         ( str.coding == RDB_STR_VAL && str.s_len > MAX_COMPACT_VALUE ) ) {
+      this->overflow = true;
+      this->collect  = false;
+      return;
+    }
+  }
+  if ( this->elem_cnt == this->elem_size ) {
+    size_t      sz = ( this->elem_size == 0 ? 64 : this->elem_size * 2 );
+    RdbString * p  = (RdbString *) ::realloc( this->elem,
+                                              sz * sizeof( RdbString ) );
+    if ( p == NULL ) {
+      this->overflow = true;
+      this->collect  = false;
+      return;
+    }
+    this->elem      = p;
+    this->elem_size = sz;
+  }
+  this->elem[ this->elem_cnt++ ] = str;
+}
+
+uint8_t *
+RdbTranscode::alloc( size_t len ) noexcept
+{
+  if ( this->buf_len + len > this->buf_size ) {
+    size_t    sz = this->buf_size * 2;
+    uint8_t * p;
+    if ( sz < this->buf_len + len )
+      sz = this->buf_len + len + 1024;
+    if ( (p = (uint8_t *) ::realloc( this->buf, sz )) == NULL )
+      return NULL;
+    this->buf      = p;
+    this->buf_size = sz;
+  }
+  uint8_t * b = &this->buf[ this->buf_len ];
+  this->buf_len += len;
+  return b;
+}
+
+bool
+rdbparser::str_to_int( const char *s,  size_t len,  int64_t &ival ) noexcept
+{
+  uint64_t v = 0;
+  size_t   i = 0;
+  bool     neg = false;
+
+  if ( len == 0 || len > 20 )
+    return false;
+  if ( s[ 0 ] == '-' ) {
+    neg = true;
+    if ( ++i == len )
+      return false;
+  }
+  if ( s[ i ] < '1' || s[ i ] > '9' )
+    return ( len == 1 && s[ 0 ] == '0' ) ? ( ival = 0, true ) : false;
+  for ( ; i < len; i++ ) {
+    if ( s[ i ] < '0' || s[ i ] > '9' )
+      return false;
+    if ( v > ( (uint64_t) -1 - 9 ) / 10 )
+      return false;
+    v = v * 10 + (uint64_t) ( s[ i ] - '0' );
+  }
+  if ( neg ) {
+    if ( v > (uint64_t) 1 << 63 )
+      return false;
+    ival = (int64_t) ( (uint64_t) 0 - v );
+  }
+  else {
+    if ( v > (uint64_t) INT64_MAX )
+      return false;
+    ival = (int64_t) v;
+  }
+  return true;
+}
+
+/* an element is either an integer or a string, doubles are formatted into
+ * tmp like d2string() does, return true if is an integer */
+static bool
+elem_value( const RdbString &str,  char *tmp,  size_t tmplen,
+            const char *&s,  size_t &len,  int64_t &ival )
+{
+  switch ( str.coding ) {
+    case RDB_INT_VAL:
+      ival = str.ival;
+      return true;
+    case RDB_STR_VAL:
+      if ( str_to_int( str.s, str.s_len, ival ) )
+        return true;
+      s   = str.s;
+      len = str.s_len;
+      return false;
+    case RDB_DBL_VAL:
+      if ( str.fval >= -9007199254740992.0 && str.fval <= 9007199254740992.0 &&
+           str.fval == (double) (int64_t) str.fval ) {
+        ival = (int64_t) str.fval;
+        return true;
+      }
+      len = (size_t) ::snprintf( tmp, tmplen, "%.17g", str.fval );
+      s   = tmp;
+      return false;
+    default:
+      s   = tmp;
+      len = 0;
+      return false;
+  }
+}
+
+/* ziplist elements are all coded as strings */
+static void
+elem_string( const RdbString &str,  char *tmp,  size_t tmplen,
+             const char *&s,  size_t &len )
+{
+  int64_t ival;
+  if ( elem_value( str, tmp, tmplen, s, len, ival ) ) {
+    len = (size_t) ::snprintf( tmp, tmplen, "%" PRId64, ival );
+    s   = tmp;
+  }
+}
+
+/* copy a built ziplist or listpack as an rdb string */
+bool
+RdbTranscode::append_blob( const uint8_t *blob,  size_t blob_len ) noexcept
+{
+  RdbLenEncode len;
+  uint8_t    * b;
+  size_t       sz = len.len_size( blob_len );
+  if ( blob_len == 0 || (b = this->alloc( sz + blob_len )) == NULL )
+    return false;
+  len.len_encode( b );
+  ::memcpy( &b[ sz ], blob, blob_len );
+  return true;
+}
+
+bool
+RdbTranscode::append_ziplist( size_t i,  size_t n ) noexcept
+{
+  char         tmp[ 32 ];
+  const char * s;
+  size_t       sz, j;
+
+  this->zb.start();
+  for ( j = i; j < i + n; j++ ) {
+    elem_string( this->elem[ j ], tmp, sizeof( tmp ), s, sz );
+    this->zb.append_str( s, sz );
+  }
+  return this->append_blob( this->zb.buf, this->zb.finish() );
+}
+
+bool
+RdbTranscode::append_listpack( size_t i,  size_t n ) noexcept
+{
+  char         tmp[ 32 ];
+  const char * s = NULL;
+  size_t       sz = 0, j;
+  int64_t      ival = 0;
+
+  this->lb.start();
+  for ( j = i; j < i + n; j++ ) {
+    if ( elem_value( this->elem[ j ], tmp, sizeof( tmp ), s, sz, ival ) )
+      this->lb.append_int( ival );
+    else
+      this->lb.append_str( s, sz );
+  }
+  return this->append_blob( this->lb.buf, this->lb.finish() );
+}
+
+/* split the list into nodes of about MAX_NODE_SIZE bytes */
+static size_t
+node_end( const RdbString *elem,  size_t i,  size_t cnt,  size_t max_size )
+{
+  size_t sz = 0;
+  for ( ; i < cnt; i++ ) {
+    size_t n = 11; /* link overhead, or the size of an integer */
+    if ( elem[ i ].coding == RDB_STR_VAL )
+      n += elem[ i ].s_len;
+    if ( sz > 0 && sz + n > max_size )
+      break;
+    sz += n;
+  }
+  return i;
+}
+
+bool
+RdbTranscode::append_quicklist( void ) noexcept
+{
+  RdbLenEncode len;
+  uint8_t    * b;
+  size_t       i, j, nodes = 0;
+
+  for ( i = 0; i < this->elem_cnt; i = j, nodes++ )
+    j = node_end( this->elem, i, this->elem_cnt, MAX_NODE_SIZE );
+  if ( (b = this->alloc( len.len_size( nodes ) )) == NULL )
+    return false;
+  len.len_encode( b );
+  for ( i = 0; i < this->elem_cnt; i = j ) {
+    j = node_end( this->elem, i, this->elem_cnt, MAX_NODE_SIZE );
+    if ( this->ver >= 10 ) {
+      if ( (b = this->alloc( 1 )) == NULL )
+        return false;
+      b[ 0 ] = 2; /* PACKED container */
+      if ( ! this->append_listpack( i, j - i ) )
+        return false;
+    }
+    else {
+      if ( ! this->append_ziplist( i, j - i ) )
+        return false;
+    }
+  }
+  return true;
+}
+
+double
+rdbparser::str_to_double( const RdbString &str ) noexcept
+{
+  char tmp[ 64 ];
+  switch ( str.coding ) {
+    case RDB_INT_VAL: return (double) str.ival;
+    case RDB_DBL_VAL: return str.fval;
+    case RDB_STR_VAL: {
+      size_t len = str.s_len < sizeof( tmp ) ? str.s_len : sizeof( tmp ) - 1;
+      ::memcpy( tmp, str.s, len );
+      tmp[ len ] = '\0';
+      return ::strtod( tmp, NULL );
+    }
+    default: return 0;
+  }
+}
+
+/* order by score, then by member, like zslInsert() */
+static int
+cmp_zset_pair( const void *x,  const void *y )
+{
+  const RdbString * a = (const RdbString *) x,
+                  * b = (const RdbString *) y;
+  double as = str_to_double( a[ 1 ] ),
+         bs = str_to_double( b[ 1 ] );
+  if ( as != bs )
+    return as < bs ? -1 : 1;
+
+  char         atmp[ 32 ], btmp[ 32 ];
+  const char * am, * bm;
+  size_t       alen, blen;
+  elem_string( a[ 0 ], atmp, sizeof( atmp ), am, alen );
+  elem_string( b[ 0 ], btmp, sizeof( btmp ), bm, blen );
+  int n = ::memcmp( am, bm, alen < blen ? alen : blen );
+  if ( n == 0 )
+    return alen < blen ? -1 : alen > blen ? 1 : 0;
+  return n;
+}
+
+void
+RdbTranscode::sort_zset( void ) noexcept
+{
+  ::qsort( this->elem, this->elem_cnt / 2, sizeof( RdbString ) * 2,
+           cmp_zset_pair );
+}
+
+RdbTranscode::Status
+RdbTranscode::encode( void ) noexcept
+{
+  RdbType t = target_type( this->src, this->ver );
+  bool    b = false;
+
+  this->buf_len = 0;
+  if ( t == RDB_BAD_TYPE )
+    return TC_NOTSUP;
+  if ( t == this->src || this->overflow || this->elem_cnt == 0 )
+    return TC_SAME;
+  switch ( t ) {
+    case RDB_ZSET_ZIPLIST:
+    case RDB_ZSET_LISTPACK:
+      /* skiplist is saved from high to low score */
+      if ( ! is_compact_type( this->src ) )
+        this->sort_zset();
+      /* FALLTHRU */
+    case RDB_HASH_ZIPLIST:
+    case RDB_HASH_LISTPACK:
+      if ( ( this->elem_cnt & 1 ) != 0 )
+        return TC_SAME;
+      if ( this->ver >= 10 )
+        b = this->append_listpack( 0, this->elem_cnt );
+      else
+        b = this->append_ziplist( 0, this->elem_cnt );
+      break;
+    case RDB_LIST_QUICKLIST:
+    case RDB_LIST_QUICKLIST_2:
+      b = this->append_quicklist();
+      break;
+    default:
+      break;
+  }
+  if ( ! b )
+    return TC_SAME;
+  this->type = t;
+  return TC_ENCODED;
+}
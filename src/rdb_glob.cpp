@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <rdbparser/rdb_glob.h>
+
+using namespace rdbparser;
+
+/* memmem() is vectorized by glibc, windows doesn't have it */
+static inline const uint8_t *
+find_lit( const uint8_t *s,  size_t len,  const uint8_t *lit,
+          size_t lit_len ) noexcept
+{
+#ifndef _MSC_VER
+  return (const uint8_t *) ::memmem( s, len, lit, lit_len );
+#else
+  const uint8_t * end = &s[ len ];
+  while ( (size_t) ( end - s ) >= lit_len ) {
+    s = (const uint8_t *) ::memchr( s, lit[ 0 ], end - s - lit_len + 1 );
+    if ( s == NULL )
+      break;
+    if ( ::memcmp( s, lit, lit_len ) == 0 )
+      return s;
+    s++;
+  }
+  return NULL;
+#endif
+}
+
+static inline void
+set_bit( uint64_t *set,  uint8_t c )
+{
+  set[ c >> 6 ] |= (uint64_t) 1 << ( c & 63 );
+}
+
+static inline bool
+test_bit( const uint64_t *set,  uint8_t c )
+{
+  return ( set[ c >> 6 ] & ( (uint64_t) 1 << ( c & 63 ) ) ) != 0;
+}
+
+void
+RdbGlob::release( void ) noexcept
+{
+  if ( this->lit != NULL ) ::free( this->lit );
+  if ( this->set != NULL ) ::free( this->set );
+  if ( this->op != NULL )  ::free( this->op );
+  if ( this->seg != NULL ) ::free( this->seg );
+  this->lit = NULL;
+  this->set = NULL;
+  this->op  = NULL;
+  this->seg = NULL;
+  this->lit_len = this->set_cnt = this->op_cnt = this->seg_cnt = 0;
+  this->min_len = 0;
+}
+
+bool
+RdbGlob::compile( const char *expr,  size_t expr_len,  bool ign_case ) noexcept
+{
+  size_t i, sets = 0;
+  Seg  * sg;
+
+  this->release();
+  this->ignore_case = ign_case;
+  for ( i = 0; i < expr_len; i++ )
+    if ( expr[ i ] == '[' )
+      sets++;
+  this->lit = (uint8_t *) ::malloc( expr_len + 1 );
+  this->set = (uint64_t *) ::malloc( ( sets + 1 ) * 4 * sizeof( uint64_t ) );
+  this->op  = (Op *) ::malloc( ( expr_len + 1 ) * sizeof( Op ) );
+  this->seg = (Seg *) ::malloc( ( expr_len + 1 ) * sizeof( Seg ) );
+  if ( this->lit == NULL || this->set == NULL || this->op == NULL ||
+       this->seg == NULL ) {
+    ::perror( "malloc" );
+    this->release();
+    return false;
+  }
+  sg = &this->seg[ this->seg_cnt++ ];
+  ::memset( sg, 0, sizeof( *sg ) );
+
+  for ( i = 0; i < expr_len; ) {
+    uint8_t c = (uint8_t) expr[ i ];
+    Op    * prev = ( sg->op_cnt > 0 ? &this->op[ this->op_cnt - 1 ] : NULL );
+
+    if ( c == '*' ) {
+      while ( i < expr_len && expr[ i ] == '*' )
+        i++;
+      this->min_len += sg->len;
+      sg = &this->seg[ this->seg_cnt++ ];
+      ::memset( sg, 0, sizeof( *sg ) );
+      sg->op = this->op_cnt;
+      continue;
+    }
+    if ( c == '?' ) {
+      if ( prev != NULL && prev->code == G_ANY )
+        prev->len++;
+      else {
+        Op & o = this->op[ this->op_cnt++ ];
+        o.code = G_ANY; o.off = 0; o.len = 1;
+        sg->op_cnt++;
+      }
+      sg->len++;
+      i++;
+      continue;
+    }
+    if ( c == '[' ) {
+      uint64_t * bits = &this->set[ this->set_cnt * 4 ];
+      bool       inv  = false;
+      ::memset( bits, 0, 4 * sizeof( uint64_t ) );
+      if ( ++i < expr_len && expr[ i ] == '^' ) {
+        inv = true;
+        i++;
+      }
+      for (;;) {
+        if ( i >= expr_len )
+          goto malformed; /* no ] */
+        c = (uint8_t) expr[ i ];
+        if ( c == ']' )
+          break;
+        if ( c == '\\' && i + 1 < expr_len ) {
+          c = (uint8_t) expr[ ++i ];
+          set_bit( bits, c );
+        }
+        else if ( i + 2 < expr_len && expr[ i + 1 ] == '-' &&
+                  expr[ i + 2 ] != ']' ) {
+          uint8_t a = c, b = (uint8_t) expr[ i + 2 ];
+          if ( a > b ) {
+            uint8_t t = a; a = b; b = t;
+          }
+          for ( uint32_t x = a; x <= b; x++ )
+            set_bit( bits, (uint8_t) x );
+          i += 2;
+        }
+        else {
+          set_bit( bits, c );
+        }
+        i++;
+      }
+      i++; /* skip ] */
+      if ( ign_case ) {
+        for ( uint32_t x = 'a'; x <= 'z'; x++ ) {
+          if ( test_bit( bits, (uint8_t) x ) )
+            set_bit( bits, (uint8_t) ::toupper( x ) );
+          else if ( test_bit( bits, (uint8_t) ::toupper( x ) ) )
+            set_bit( bits, (uint8_t) x );
+        }
+      }
+      if ( inv ) {
+        for ( int k = 0; k < 4; k++ )
+          bits[ k ] = ~bits[ k ];
+      }
+      Op & o = this->op[ this->op_cnt++ ];
+      o.code = G_SET; o.off = this->set_cnt++; o.len = 1;
+      sg->op_cnt++;
+      sg->len++;
+      continue;
+    }
+    if ( c == '\\' && i + 1 < expr_len )
+      c = (uint8_t) expr[ ++i ];
+    if ( ign_case )
+      c = (uint8_t) ::tolower( c );
+    if ( prev != NULL && prev->code == G_LIT )
+      prev->len++;
+    else {
+      Op & o = this->op[ this->op_cnt++ ];
+      o.code = G_LIT; o.off = this->lit_len; o.len = 1;
+      sg->op_cnt++;
+    }
+    this->lit[ this->lit_len++ ] = c;
+    sg->len++;
+    i++;
+  }
+  this->min_len += sg->len;
+  /* locate the first literal of each segment, used by find_seg() */
+  for ( uint32_t k = 0; k < this->seg_cnt; k++ ) {
+    Seg    & s   = this->seg[ k ];
+    uint32_t off = 0;
+    for ( s.lit_op = 0; s.lit_op < s.op_cnt; s.lit_op++ ) {
+      const Op & o = this->op[ s.op + s.lit_op ];
+      if ( o.code == G_LIT )
+        break;
+      off += o.len;
+    }
+    s.lit_off = off;
+  }
+  return true;
+malformed:;
+  this->release();
+  return false;
+}
+
+bool
+RdbGlob::match_seg( const Seg &sg,  const uint8_t *s ) const noexcept
+{
+  for ( uint32_t k = 0; k < sg.op_cnt; k++ ) {
+    const Op & o = this->op[ sg.op + k ];
+    switch ( o.code ) {
+      case G_LIT:
+        if ( ! this->ignore_case ) {
+          if ( ::memcmp( s, &this->lit[ o.off ], o.len ) != 0 )
+            return false;
+        }
+        else {
+          for ( uint32_t j = 0; j < o.len; j++ )
+            if ( (uint8_t) ::tolower( s[ j ] ) != this->lit[ o.off + j ] )
+              return false;
+        }
+        break;
+      case G_SET:
+        if ( ! test_bit( &this->set[ o.off * 4 ], s[ 0 ] ) )
+          return false;
+        break;
+      default: /* G_ANY */
+        break;
+    }
+    s += o.len;
+  }
+  return true;
+}
+
+int64_t
+RdbGlob::find_seg( const Seg &sg,  const uint8_t *s,
+                   size_t len ) const noexcept
+{
+  size_t p = 0, last;
+
+  if ( len < sg.len )
+    return -1;
+  last = len - sg.len; /* last start position */
+  if ( sg.lit_op < sg.op_cnt && ! this->ignore_case ) {
+    const Op & o = this->op[ sg.op + sg.lit_op ];
+    while ( p <= last ) {
+      const uint8_t * x = find_lit( &s[ p + sg.lit_off ], last - p + o.len,
+                                    &this->lit[ o.off ], o.len );
+      if ( x == NULL )
+        return -1;
+      p = (size_t) ( x - s ) - sg.lit_off;
+      if ( this->match_seg( sg, &s[ p ] ) )
+        return (int64_t) p;
+      p++;
+    }
+    return -1;
+  }
+  for ( ; p <= last; p++ )
+    if ( this->match_seg( sg, &s[ p ] ) )
+      return (int64_t) p;
+  return -1;
+}
+
+bool
+RdbGlob::match( const char *str,  size_t len ) const noexcept
+{
+  const uint8_t * s = (const uint8_t *) str;
+  size_t          p, end;
+
+  if ( this->seg_cnt == 1 )
+    return len == this->seg[ 0 ].len && this->match_seg( this->seg[ 0 ], s );
+  if ( len < this->min_len )
+    return false;
+  const Seg & first = this->seg[ 0 ],
+            & last  = this->seg[ this->seg_cnt - 1 ];
+  if ( ! this->match_seg( first, s ) ||
+       ! this->match_seg( last, &s[ len - last.len ] ) )
+    return false;
+  /* the middle segments are fixed length, so the leftmost match of each
+   * leaves the most room for the rest */
+  p   = first.len;
+  end = len - last.len;
+  for ( uint32_t k = 1; k + 1 < this->seg_cnt; k++ ) {
+    const Seg & sg = this->seg[ k ];
+    int64_t     f  = this->find_seg( sg, &s[ p ], end - p );
+    if ( f < 0 )
+      return false;
+    p += (size_t) f + sg.len;
+  }
+  return true;
+}
@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <rdbparser/rdb_decode.h>
+#include <rdbparser/rdb_json.h>
+#include <rdbparser/rdb_grep.h>
+#ifdef RDB_USE_PCRE
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+#endif
+
+using namespace rdbparser;
+
+/* memmem() is vectorized by glibc, windows doesn't have it */
+static const void *
+find_needle( const void *s,  size_t len,  const char *n,
+             size_t n_len ) noexcept
+{
+#ifndef _MSC_VER
+  return ::memmem( s, len, n, n_len );
+#else
+  const char * p   = (const char *) s,
+             * end = &p[ len ];
+  while ( (size_t) ( end - p ) >= n_len ) {
+    p = (const char *) ::memchr( p, n[ 0 ], end - p - n_len + 1 );
+    if ( p == NULL )
+      break;
+    if ( ::memcmp( p, n, n_len ) == 0 )
+      return p;
+    p++;
+  }
+  return NULL;
+#endif
+}
+
+GrepOutput::~GrepOutput() noexcept
+{
+#ifdef RDB_USE_PCRE
+  if ( this->md != NULL )
+    pcre2_match_data_free( this->md );
+  if ( this->re != NULL )
+    pcre2_code_free( this->re );
+#endif
+}
+
+bool
+GrepOutput::set_needle( const char *s,  size_t len,  bool is_regex ) noexcept
+{
+  if ( is_regex ) {
+#ifdef RDB_USE_PCRE
+    size_t erroff = 0;
+    int    error  = 0;
+    this->re = pcre2_compile( (PCRE2_SPTR) s, len, PCRE2_DOTALL, &error,
+                              &erroff, 0 );
+    if ( this->re == NULL ) {
+      fprintf( stderr, "pcre(%d,%" PRId64 "): %.*s\n", error, erroff,
+               (int) len, s );
+      return false;
+    }
+    pcre2_jit_compile( this->re, PCRE2_JIT_COMPLETE );
+    this->md = pcre2_match_data_create_from_pattern( this->re, NULL );
+    if ( this->md == NULL ) {
+      ::perror( "pcre2_match_data" );
+      return false;
+    }
+    return true;
+#else
+    fprintf( stderr, "regex requires a build with pcre2 (USE_PCRE=1)\n" );
+    return false;
+#endif
+  }
+  if ( len == 0 ) {
+    fprintf( stderr, "empty needle\n" );
+    return false;
+  }
+  this->needle     = s;
+  this->needle_len = len;
+  /* if only digits, it may be in an integer of a compact encoding */
+  this->is_blob_ok = false;
+  for ( size_t i = 0; i < len; i++ ) {
+    if ( ( s[ i ] < '0' || s[ i ] > '9' ) && s[ i ] != '-' ) {
+      this->is_blob_ok = true;
+      break;
+    }
+  }
+  return true;
+}
+
+void
+GrepOutput::check_blob( void ) noexcept
+{
+  RdbDecode & d = this->dec;
+  if ( ! this->is_blob_ok || ! d.is_matched || d.rlen.is_enc )
+    return;
+  switch ( d.type ) {
+    case RDB_STRING:
+    case RDB_HASH_ZIPMAP:
+    case RDB_LIST_ZIPLIST:
+    case RDB_SET_INTSET:
+    case RDB_ZSET_ZIPLIST:
+    case RDB_HASH_ZIPLIST:
+    case RDB_HASH_LISTPACK:
+    case RDB_ZSET_LISTPACK:
+      break;
+    default:
+      return;
+  }
+  if ( d.rlen.len > this->bptr.avail )
+    return; /* truncated, let the decoder report it */
+  if ( find_needle( this->bptr.buf, d.rlen.len, this->needle,
+                    this->needle_len ) == NULL ) {
+    d.is_matched = false;
+    this->skip_cnt++;
+  }
+}
+
+bool
+GrepOutput::match( const RdbString &s ) noexcept
+{
+  const char * p;
+  size_t       len;
+  char         tmp[ 32 ];
+
+  switch ( s.coding ) {
+    case RDB_STR_VAL:
+      p   = s.s;
+      len = s.s_len;
+      break;
+    case RDB_INT_VAL:
+      len = (size_t) snprintf( tmp, sizeof( tmp ), "%" PRId64, s.ival );
+      p   = tmp;
+      break;
+    default:
+      return false;
+  }
+#ifdef RDB_USE_PCRE
+  if ( this->re != NULL )
+    return pcre2_match( this->re, (PCRE2_SPTR) p, len, 0, 0, this->md,
+                        0 ) >= 0;
+#endif
+  return len >= this->needle_len &&
+         find_needle( p, len, this->needle, this->needle_len ) != NULL;
+}
+
+void
+GrepOutput::hit( const RdbString *elem,  uint64_t idx ) noexcept
+{
+  if ( ! this->key_hit ) {
+    this->key_hit = true;
+    this->key_cnt++;
+    if ( ! this->show_elem ) {
+      print_s( this->dec.key, false ); printf( "\n" );
+      return;
+    }
+  }
+  this->elem_cnt++;
+  if ( this->show_elem ) {
+    print_s( this->dec.key, false ); printf( "\t" );
+    if ( elem != NULL )
+      print_s( *elem, false );
+    else if ( idx != 0 )
+      printf( "%" PRIu64 "", idx - 1 );
+    printf( "\n" );
+  }
+}
+
+void GrepOutput::d_start_key( void ) noexcept { this->key_hit = false; }
+
+void
+GrepOutput::d_string( const RdbString &str ) noexcept
+{
+  if ( this->match( str ) )
+    this->hit( NULL, 0 );
+}
+
+void
+GrepOutput::d_module( const RdbString &str ) noexcept
+{
+  if ( ( ! this->key_hit || this->show_elem ) && this->match( str ) )
+    this->hit( NULL, 0 );
+}
+
+void
+GrepOutput::d_hash( const RdbHashEntry &h ) noexcept
+{
+  if ( ( ! this->key_hit || this->show_elem ) &&
+       ( this->match( h.field ) || this->match( h.val ) ) )
+    this->hit( &h.field, 0 );
+}
+
+void
+GrepOutput::d_list( const RdbListElem &l ) noexcept
+{
+  if ( ( ! this->key_hit || this->show_elem ) && this->match( l.val ) )
+    this->hit( NULL, l.num + 1 );
+}
+
+void
+GrepOutput::d_set( const RdbSetMember &s ) noexcept
+{
+  if ( ( ! this->key_hit || this->show_elem ) && this->match( s.member ) )
+    this->hit( &s.member, 0 );
+}
+
+void
+GrepOutput::d_zset( const RdbZSetMember &z ) noexcept
+{
+  if ( ( ! this->key_hit || this->show_elem ) && this->match( z.member ) )
+    this->hit( &z.member, 0 );
+}
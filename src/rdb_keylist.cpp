@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <rdbparser/rdb_decode.h>
+#include <rdbparser/rdb_keylist.h>
+
+using namespace rdbparser;
+
+void
+RdbKeyListFilter::release( void ) noexcept
+{
+  if ( this->keys != NULL )
+    ::free( this->keys );
+  if ( this->tab != NULL )
+    ::free( this->tab );
+  this->keys = NULL;
+  this->tab  = NULL;
+  this->mask = 0;
+  this->cnt  = 0;
+}
+
+uint64_t
+RdbKeyListFilter::hash( const char *key,  size_t len ) const noexcept
+{
+  uint64_t h;
+  if ( ! this->ignore_case )
+    h = xxh64( 0, key, len );
+  else {
+    /* hash the lower case prefix, the whole key is compared by find() */
+    char   lc[ 256 ];
+    size_t n = ( len < sizeof( lc ) ? len : sizeof( lc ) );
+    for ( size_t i = 0; i < n; i++ )
+      lc[ i ] = (char) ::tolower( (uint8_t) key[ i ] );
+    h = xxh64( len, lc, n );
+  }
+  return ( h == 0 ? 1 : h );
+}
+
+bool
+RdbKeyListFilter::load( const char *fn,  bool ign_case,  bool inv ) noexcept
+{
+  FILE * fp = ::fopen( fn, "rb" );
+  size_t size = 0, len = 0, off, n, lines = 0;
+
+  if ( fp == NULL ) {
+    ::perror( fn );
+    return false;
+  }
+  this->release();
+  this->ignore_case = ign_case;
+  this->invert      = inv;
+  /* read the whole file, the lines are referenced by offset */
+  for (;;) {
+    if ( len == size ) {
+      size_t sz = ( size == 0 ? 64 * 1024 : size * 2 );
+      char * p  = (char *) ::realloc( this->keys, sz );
+      if ( p == NULL ) {
+        ::perror( "realloc" );
+        ::fclose( fp );
+        return false;
+      }
+      this->keys = p;
+      size       = sz;
+    }
+    if ( (n = ::fread( &this->keys[ len ], 1, size - len, fp )) == 0 )
+      break;
+    len += n;
+  }
+  if ( ::ferror( fp ) ) {
+    ::perror( fn );
+    ::fclose( fp );
+    return false;
+  }
+  ::fclose( fp );
+  for ( size_t i = 0; i < len; i++ )
+    if ( this->keys[ i ] == '\n' )
+      lines++;
+  /* the table is sized once, load under 1/2 */
+  for ( size = 1024; size < lines * 2 + 2; size *= 2 )
+    ;
+  this->tab = (RdbKeyListEntry *) ::calloc( size, sizeof( RdbKeyListEntry ) );
+  if ( this->tab == NULL ) {
+    ::perror( "calloc" );
+    return false;
+  }
+  this->mask = size - 1;
+  for ( off = 0; off < len; off = n + 1 ) {
+    size_t end;
+    for ( n = off; n < len && this->keys[ n ] != '\n'; n++ )
+      ;
+    end = n;
+    if ( end > off && this->keys[ end - 1 ] == '\r' )
+      end--;
+    if ( end > off )
+      this->insert( off, end - off );
+  }
+  return true;
+}
+
+bool
+RdbKeyListFilter::insert( size_t off,  size_t len ) noexcept
+{
+  const char * key = &this->keys[ off ];
+  uint64_t     h   = this->hash( key, len );
+  size_t       j   = (size_t) h & this->mask;
+
+  if ( this->ignore_case ) {
+    for ( size_t i = 0; i < len; i++ )
+      this->keys[ off + i ] = (char) ::tolower( (uint8_t) key[ i ] );
+  }
+  for (;;) {
+    RdbKeyListEntry & e = this->tab[ j ];
+    if ( e.hash == 0 )
+      break;
+    if ( e.hash == h && e.len == len &&
+         ::memcmp( &this->keys[ e.off ], key, len ) == 0 )
+      return false;
+    j = ( j + 1 ) & this->mask;
+  }
+  this->tab[ j ].hash = h;
+  this->tab[ j ].off  = off;
+  this->tab[ j ].len  = len;
+  this->cnt++;
+  return true;
+}
+
+bool
+RdbKeyListFilter::find( const char *key,  size_t len ) const noexcept
+{
+  uint64_t h = this->hash( key, len );
+  size_t   j = (size_t) h & this->mask;
+
+  for (;;) {
+    const RdbKeyListEntry & e = this->tab[ j ];
+    if ( e.hash == 0 )
+      return false;
+    if ( e.hash == h && e.len == len ) {
+      const char * k = &this->keys[ e.off ];
+      if ( ! this->ignore_case ) {
+        if ( ::memcmp( k, key, len ) == 0 )
+          return true;
+      }
+      else {
+        size_t i = 0;
+        while ( i < len && k[ i ] == (char) ::tolower( (uint8_t) key[ i ] ) )
+          i++;
+        if ( i == len )
+          return true;
+      }
+    }
+    j = ( j + 1 ) & this->mask;
+  }
+}
+
+bool
+RdbKeyListFilter::match_key( const RdbString &key ) noexcept
+{
+  bool matched;
+
+  if ( this->tab == NULL )
+    matched = false;
+  else if ( key.coding == RDB_STR_VAL )
+    matched = this->find( key.s, key.s_len );
+  else {
+    char tmp[ 32 ];
+    int  n = snprintf( tmp, sizeof( tmp ), "%" PRId64, key.ival );
+    matched = this->find( tmp, (size_t) n );
+  }
+  if ( this->invert )
+    return ! matched;
+  return matched;
+}
@@ -0,0 +1,532 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#if ! defined( _MSC_VER ) && ! defined( __MINGW32__ )
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#define RDB_HAS_SOCKETS 1
+#endif
+#include <rdbparser/rdb_decode.h>
+#include <rdbparser/rdb_load.h>
+
+using namespace rdbparser;
+
+#ifdef RDB_HAS_SOCKETS
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+/* kbuf entry header: [len(4)][us(8)] */
+static const size_t KEY_HDR_SIZE = sizeof( uint32_t ) + sizeof( uint64_t );
+/* len of a kbuf entry for a SELECT, which has no key */
+static const uint32_t KEY_SELECT = 0xffffffffU;
+
+/* make room for len more bytes at buf[ off ] */
+static bool
+grow_buf( uint8_t *&buf,  size_t &size,  size_t off,  size_t len )
+{
+  if ( off + len <= size )
+    return true;
+  size_t sz = ( size == 0 ? 16 * 1024 : size );
+  while ( sz < off + len )
+    sz *= 2;
+  uint8_t * p = (uint8_t *) ::realloc( buf, sz );
+  if ( p == NULL )
+    return false;
+  buf  = p;
+  size = sz;
+  return true;
+}
+
+static int
+connect_unix( const char *path )
+{
+  struct sockaddr_un sun;
+  size_t len = ::strlen( path );
+  if ( len >= sizeof( sun.sun_path ) ) {
+    fprintf( stderr, "socket path too long: %s\n", path );
+    return -1;
+  }
+  ::memset( &sun, 0, sizeof( sun ) );
+  sun.sun_family = AF_UNIX;
+  ::memcpy( sun.sun_path, path, len );
+  int fd = ::socket( AF_UNIX, SOCK_STREAM, 0 );
+  if ( fd < 0 ) {
+    ::perror( "socket" );
+    return -1;
+  }
+  if ( ::connect( fd, (struct sockaddr *) &sun, sizeof( sun ) ) != 0 ) {
+    ::perror( path );
+    ::close( fd );
+    return -1;
+  }
+  return fd;
+}
+
+static int
+connect_tcp( const char *addr )
+{
+  char         host[ 256 ];
+  const char * port = ::strrchr( addr, ':' );
+  size_t       len  = ( port != NULL ? (size_t) ( port - addr )
+                                     : ::strlen( addr ) );
+  if ( len >= sizeof( host ) ) {
+    fprintf( stderr, "host too long: %s\n", addr );
+    return -1;
+  }
+  ::memcpy( host, addr, len );
+  host[ len ] = '\0';
+  port = ( port != NULL ? &port[ 1 ] : "6379" );
+
+  struct addrinfo hints, * res = NULL, * p;
+  ::memset( &hints, 0, sizeof( hints ) );
+  hints.ai_family   = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  int status = ::getaddrinfo( len == 0 ? "127.0.0.1" : host, port, &hints,
+                              &res );
+  if ( status != 0 ) {
+    fprintf( stderr, "%s: %s\n", addr, ::gai_strerror( status ) );
+    return -1;
+  }
+  int fd = -1;
+  for ( p = res; p != NULL; p = p->ai_next ) {
+    fd = ::socket( p->ai_family, p->ai_socktype, p->ai_protocol );
+    if ( fd < 0 )
+      continue;
+    if ( ::connect( fd, p->ai_addr, p->ai_addrlen ) == 0 )
+      break;
+    ::close( fd );
+    fd = -1;
+  }
+  ::freeaddrinfo( res );
+  if ( fd < 0 ) {
+    ::perror( addr );
+    return -1;
+  }
+  int on = 1;
+  ::setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof( on ) );
+  return fd;
+}
+
+bool
+RestoreLoader::connect( const char *addr,  size_t nconn,  size_t win ) noexcept
+{
+  if ( nconn == 0 )
+    nconn = 1;
+  if ( win == 0 )
+    win = 1;
+  this->conn = (RestoreConn *) ::calloc( nconn, sizeof( RestoreConn ) );
+  this->pfd  = (struct pollfd *) ::calloc( nconn, sizeof( struct pollfd ) );
+  if ( this->conn == NULL || this->pfd == NULL ) {
+    ::perror( "calloc" );
+    return false;
+  }
+  this->window  = win;
+  this->win_cur = win;
+  for ( size_t i = 0; i < nconn; i++ ) {
+    RestoreConn & c = this->conn[ i ];
+    this->conn_cnt++;
+    c.fd = ( ::strchr( addr, '/' ) != NULL ? connect_unix( addr )
+                                           : connect_tcp( addr ) );
+    if ( c.fd < 0 )
+      return false;
+    ::fcntl( c.fd, F_SETFL, ::fcntl( c.fd, F_GETFL ) | O_NONBLOCK );
+  }
+  return true;
+}
+
+void
+RestoreLoader::close( void ) noexcept
+{
+  for ( size_t i = 0; i < this->conn_cnt; i++ ) {
+    RestoreConn & c = this->conn[ i ];
+    if ( c.fd >= 0 )
+      ::close( c.fd );
+    if ( c.sbuf != NULL ) ::free( c.sbuf );
+    if ( c.rbuf != NULL ) ::free( c.rbuf );
+    if ( c.kbuf != NULL ) ::free( c.kbuf );
+  }
+  if ( this->conn != NULL )
+    ::free( this->conn );
+  if ( this->pfd != NULL )
+    ::free( this->pfd );
+  this->conn     = NULL;
+  this->pfd      = NULL;
+  this->cur      = NULL;
+  this->conn_cnt = 0;
+}
+
+RestoreConn *
+RestoreLoader::get_conn( void ) noexcept
+{
+  for (;;) {
+    if ( this->failed )
+      return NULL;
+    /* least loaded conn, starting at the round robin position */
+    RestoreConn * best = NULL;
+    for ( size_t i = 0; i < this->conn_cnt; i++ ) {
+      RestoreConn & c = this->conn[ ( this->next + i ) % this->conn_cnt ];
+      if ( c.in_flight < this->win_cur &&
+           ( best == NULL || c.in_flight < best->in_flight ) )
+        best = &c;
+    }
+    if ( best != NULL ) {
+      this->next = ( this->next + 1 ) % this->conn_cnt;
+      return best;
+    }
+    /* all windows are full, wait for replies */
+    if ( ! this->poll_io( -1 ) )
+      return NULL;
+  }
+}
+
+void
+RestoreLoader::start_cmd( const RdbString &,  uint64_t db,
+                          size_t len ) noexcept
+{
+  this->cur       = this->get_conn();
+  this->cur_large = ( len >= SEND_FLUSH_SIZE );
+  if ( this->cur != NULL && this->cur->db != db &&
+       ! this->select_db( *this->cur, db ) )
+    this->cur = NULL;
+  /* send the batch ahead of a large value, so the batch is not held
+   * behind it */
+  if ( this->cur != NULL && this->cur_large )
+    this->send_data( *this->cur );
+}
+
+void
+RestoreLoader::wait( uint64_t us ) noexcept
+{
+  bool busy = false;
+  for ( size_t i = 0; i < this->conn_cnt; i++ ) {
+    RestoreConn & c = this->conn[ i ];
+    if ( c.s_off < c.s_len )
+      this->send_data( c );
+    if ( c.in_flight > 0 || c.s_off < c.s_len )
+      busy = true;
+  }
+  if ( busy )
+    this->poll_io( (int) ( ( us + 999 ) / 1000 ) );
+  else
+    sleep_us( us );
+}
+
+void
+RestoreLoader::adapt_window( uint64_t lat_us,  uint64_t now_us ) noexcept
+{
+  if ( lat_us > this->max_lat_us ) {
+    /* cut once per round trip, the replies after a cut were already in
+     * flight */
+    if ( now_us - this->win_cut_us > lat_us ) {
+      this->win_cur    = ( this->win_cur > 1 ? this->win_cur / 2 : 1 );
+      this->win_cut_us = now_us;
+    }
+    this->win_credit = 0;
+  }
+  else if ( ++this->win_credit >= this->win_cur * this->conn_cnt ) {
+    if ( this->win_cur < this->window )
+      this->win_cur++;
+    this->win_credit = 0;
+  }
+}
+
+void
+RestoreLoader::write( const void *p,  size_t len ) noexcept
+{
+  if ( this->cur == NULL ) /* failed */
+    return;
+  RestoreConn & c = *this->cur;
+  if ( ! grow_buf( c.sbuf, c.s_size, c.s_len, len ) ) {
+    ::perror( "realloc" );
+    this->failed = true;
+    return;
+  }
+  ::memcpy( &c.sbuf[ c.s_len ], p, len );
+  c.s_len += len;
+  /* large values, don't buffer all of it */
+  while ( ! this->failed && c.s_len - c.s_off > SEND_WAIT_SIZE ) {
+    if ( ! this->send_data( c ) || c.s_len - c.s_off > SEND_WAIT_SIZE )
+      this->poll_io( -1 );
+  }
+}
+
+void
+RestoreLoader::end_cmd( const RdbString &key ) noexcept
+{
+  if ( this->cur == NULL ) /* failed */
+    return;
+  RestoreConn & c = *this->cur;
+  uint32_t klen = (uint32_t) key.s_len;
+  uint64_t us   = RestorePacer::mono_us();
+  this->cur = NULL;
+  if ( ! grow_buf( c.kbuf, c.k_size, c.k_len, KEY_HDR_SIZE + klen ) ) {
+    ::perror( "realloc" );
+    this->failed = true;
+    return;
+  }
+  ::memcpy( &c.kbuf[ c.k_len ], &klen, sizeof( klen ) );
+  ::memcpy( &c.kbuf[ c.k_len + sizeof( klen ) ], &us, sizeof( us ) );
+  ::memcpy( &c.kbuf[ c.k_len + KEY_HDR_SIZE ], key.s, klen );
+  c.k_len += KEY_HDR_SIZE + klen;
+  c.in_flight++;
+  this->sent_cnt++;
+  if ( this->cur_large || c.s_len - c.s_off >= SEND_FLUSH_SIZE ||
+       c.in_flight >= this->win_cur )
+    this->send_data( c );
+}
+
+bool
+RestoreLoader::select_db( RestoreConn &c,  uint64_t db ) noexcept
+{
+  char     sel[ 64 ];
+  size_t   len  = RestoreSink::select_cmd( sel, sizeof( sel ), db );
+  uint32_t klen = KEY_SELECT;
+  uint64_t us   = RestorePacer::mono_us();
+  if ( ! grow_buf( c.sbuf, c.s_size, c.s_len, len ) ||
+       ! grow_buf( c.kbuf, c.k_size, c.k_len, KEY_HDR_SIZE ) ) {
+    ::perror( "realloc" );
+    this->failed = true;
+    return false;
+  }
+  ::memcpy( &c.sbuf[ c.s_len ], sel, len );
+  c.s_len += len;
+  ::memcpy( &c.kbuf[ c.k_len ], &klen, sizeof( klen ) );
+  ::memcpy( &c.kbuf[ c.k_len + sizeof( klen ) ], &us, sizeof( us ) );
+  c.k_len += KEY_HDR_SIZE;
+  c.in_flight++;
+  c.db = db;
+  return true;
+}
+
+/* send without blocking, return false if nothing could be sent */
+bool
+RestoreLoader::send_data( RestoreConn &c ) noexcept
+{
+  bool progress = false;
+  while ( c.s_off < c.s_len ) {
+    ssize_t n = ::send( c.fd, &c.sbuf[ c.s_off ], c.s_len - c.s_off,
+                        MSG_NOSIGNAL );
+    if ( n < 0 ) {
+      if ( errno == EINTR )
+        continue;
+      if ( errno != EAGAIN && errno != EWOULDBLOCK ) {
+        ::perror( "send" );
+        this->failed = true;
+      }
+      break;
+    }
+    c.s_off += (size_t) n;
+    progress = true;
+  }
+  if ( c.s_off == c.s_len )
+    c.s_off = c.s_len = 0;
+  return progress;
+}
+
+bool
+RestoreLoader::recv_data( RestoreConn &c ) noexcept
+{
+  for (;;) {
+    if ( ! grow_buf( c.rbuf, c.r_size, c.r_len, 4096 ) ) {
+      ::perror( "realloc" );
+      this->failed = true;
+      return false;
+    }
+    ssize_t n = ::recv( c.fd, &c.rbuf[ c.r_len ], c.r_size - c.r_len, 0 );
+    if ( n < 0 ) {
+      if ( errno == EINTR )
+        continue;
+      if ( errno == EAGAIN || errno == EWOULDBLOCK )
+        break;
+      ::perror( "recv" );
+      this->failed = true;
+      return false;
+    }
+    if ( n == 0 ) {
+      fprintf( stderr, "connection closed with %" PRIu64 " in flight\n",
+               (uint64_t) c.in_flight );
+      this->failed = true;
+      return false;
+    }
+    c.r_len += (size_t) n;
+  }
+  this->process_replies( c );
+  return true;
+}
+
+/* return the size of the reply at b, or 0 if it is not complete */
+static size_t
+reply_size( const uint8_t *b,  size_t len )
+{
+  const uint8_t * eol = (const uint8_t *) ::memchr( b, '\n', len );
+  if ( eol == NULL )
+    return 0;
+  size_t   hdr = (size_t) ( eol - b ) + 1;
+  long long  n = ( b[ 0 ] == '$' || b[ 0 ] == '*' ) ?
+                 ::strtoll( (const char *) &b[ 1 ], NULL, 10 ) : 0;
+  if ( b[ 0 ] == '$' ) {
+    if ( n < 0 )
+      return hdr;
+    if ( hdr + (size_t) n + 2 > len )
+      return 0;
+    return hdr + (size_t) n + 2;
+  }
+  if ( b[ 0 ] == '*' ) {
+    size_t off = hdr;
+    for ( ; n > 0; n-- ) {
+      size_t sz = reply_size( &b[ off ], len - off );
+      if ( sz == 0 )
+        return 0;
+      off += sz;
+    }
+    return off;
+  }
+  return hdr; /* +simple, -error, :int */
+}
+
+void
+RestoreLoader::process_replies( RestoreConn &c ) noexcept
+{
+  size_t   off = 0, sz;
+  uint64_t now = RestorePacer::mono_us();
+  while ( off < c.r_len &&
+          (sz = reply_size( &c.rbuf[ off ], c.r_len - off )) != 0 ) {
+    const uint8_t * r = &c.rbuf[ off ];
+    uint32_t        klen = 0;
+    uint64_t        us   = now;
+    if ( c.k_off < c.k_len ) {
+      ::memcpy( &klen, &c.kbuf[ c.k_off ], sizeof( klen ) );
+      ::memcpy( &us, &c.kbuf[ c.k_off + sizeof( klen ) ], sizeof( us ) );
+    }
+    if ( klen == KEY_SELECT ) { /* not a key, only errors are counted */
+      if ( r[ 0 ] == '-' ) {
+        fprintf( stderr, "SELECT: %.*s\n", (int) sz - 3,
+                 (const char *) &r[ 1 ] );
+        this->err_cnt++;
+      }
+      c.k_off += KEY_HDR_SIZE;
+      if ( c.k_off == c.k_len )
+        c.k_off = c.k_len = 0;
+      c.in_flight--;
+      off += sz;
+      continue;
+    }
+    if ( r[ 0 ] == '-' ) {
+      size_t rlen = sz;
+      while ( rlen > 0 && ( r[ rlen - 1 ] == '\n' || r[ rlen - 1 ] == '\r' ) )
+        rlen--;
+      fprintf( stderr, "Key \"%.*s\": %.*s\n", (int) klen,
+               (const char *) &c.kbuf[ c.k_off + KEY_HDR_SIZE ],
+               (int) rlen - 1, (const char *) &r[ 1 ] );
+      this->err_cnt++;
+    }
+    else {
+      this->ok_cnt++;
+    }
+    this->lat_sum += now - us;
+    if ( this->max_lat_us != 0 )
+      this->adapt_window( now - us, now );
+    if ( c.k_off < c.k_len )
+      c.k_off += KEY_HDR_SIZE + klen;
+    if ( c.k_off == c.k_len )
+      c.k_off = c.k_len = 0;
+    if ( c.in_flight > 0 )
+      c.in_flight--;
+    off += sz;
+  }
+  if ( off > 0 ) {
+    ::memmove( c.rbuf, &c.rbuf[ off ], c.r_len - off );
+    c.r_len -= off;
+  }
+}
+
+bool
+RestoreLoader::poll_io( int timeout_ms ) noexcept
+{
+  struct pollfd * pfd = this->pfd;
+  size_t          i;
+
+  for ( i = 0; i < this->conn_cnt; i++ ) {
+    RestoreConn & c = this->conn[ i ];
+    pfd[ i ].fd      = c.fd;
+    pfd[ i ].events  = ( c.in_flight > 0 ? POLLIN : 0 ) |
+                       ( c.s_off < c.s_len ? POLLOUT : 0 );
+    pfd[ i ].revents = 0;
+  }
+  int cnt = ::poll( pfd, this->conn_cnt, timeout_ms );
+  if ( cnt < 0 ) {
+    if ( errno == EINTR )
+      return true;
+    ::perror( "poll" );
+    this->failed = true;
+    return false;
+  }
+  for ( i = 0; i < this->conn_cnt && cnt > 0; i++ ) {
+    RestoreConn & c = this->conn[ i ];
+    if ( pfd[ i ].revents == 0 )
+      continue;
+    cnt--;
+    if ( ( pfd[ i ].revents & POLLOUT ) != 0 )
+      this->send_data( c );
+    if ( ( pfd[ i ].revents & ( POLLIN | POLLHUP | POLLERR ) ) != 0 )
+      this->recv_data( c );
+    if ( this->failed )
+      return false;
+  }
+  return true;
+}
+
+bool
+RestoreLoader::drain( void ) noexcept
+{
+  for (;;) {
+    bool busy = false;
+    for ( size_t i = 0; i < this->conn_cnt; i++ ) {
+      RestoreConn & c = this->conn[ i ];
+      if ( c.s_off < c.s_len )
+        this->send_data( c );
+      if ( c.in_flight > 0 || c.s_off < c.s_len )
+        busy = true;
+    }
+    if ( ! busy || this->failed )
+      break;
+    if ( ! this->poll_io( -1 ) )
+      break;
+  }
+  return ! this->failed;
+}
+
+#else /* no sockets */
+
+bool
+RestoreLoader::connect( const char *,  size_t,  size_t ) noexcept
+{
+  fprintf( stderr, "loader not supported on this platform\n" );
+  return false;
+}
+void RestoreLoader::close( void ) noexcept {}
+void RestoreLoader::start_cmd( const RdbString &,  uint64_t,  size_t ) noexcept {}
+void RestoreLoader::wait( uint64_t ) noexcept {}
+void RestoreLoader::adapt_window( uint64_t,  uint64_t ) noexcept {}
+void RestoreLoader::write( const void *,  size_t ) noexcept {}
+void RestoreLoader::end_cmd( const RdbString & ) noexcept {}
+bool RestoreLoader::drain( void ) noexcept { return false; }
+RestoreConn * RestoreLoader::get_conn( void ) noexcept { return NULL; }
+bool RestoreLoader::poll_io( int ) noexcept { return false; }
+bool RestoreLoader::send_data( RestoreConn & ) noexcept { return false; }
+bool RestoreLoader::recv_data( RestoreConn & ) noexcept { return false; }
+bool RestoreLoader::select_db( RestoreConn &,  uint64_t ) noexcept { return false; }
+void RestoreLoader::process_replies( RestoreConn & ) noexcept {}
+
+#endif
@@ -22,7 +22,18 @@
 #include <rdbparser/rdb_decode.h>
 #include <rdbparser/rdb_json.h>
 #include <rdbparser/rdb_restore.h>
+#include <rdbparser/rdb_load.h>
+#include <rdbparser/rdb_slot.h>
+#include <rdbparser/rdb_copy.h>
+#include <rdbparser/rdb_diff.h>
 #include <rdbparser/rdb_pcre.h>
+#include <rdbparser/rdb_keylist.h>
+#include <rdbparser/rdb_where.h>
+#include <rdbparser/rdb_grep.h>
+#include <rdbparser/rdb_stats.h>
+#include <rdbparser/rdb_memory.h>
+#include <rdbparser/rdb_prefix.h>
+#include <rdbparser/rdb_ttl.h>
 
 using namespace rdbparser;
 
@@ -138,6 +149,162 @@ fill_buf_stdin( void )
   exit( 1 );
 }
 
+/* map the file fn read only, return NULL and print the error if fails */
+static void *
+map_file( const char *fn,  size_t &len )
+{
+  void * map;
+#ifndef RDB_WINDOWS
+  int fd = ::open( fn, O_RDONLY );
+  struct stat st;
+  if ( fd < 0 ) {
+    ::perror( fn );
+    return NULL;
+  }
+  if ( ::fstat( fd, &st ) != 0 ) {
+    ::perror( "fstat" );
+    ::close( fd );
+    return NULL;
+  }
+  len = st.st_size;
+  map = ::mmap( 0, len, PROT_READ, MAP_SHARED, fd, 0 );
+  if ( map == MAP_FAILED ) {
+    ::perror( "mmap" );
+    ::close( fd );
+    return NULL;
+  }
+  ::close( fd );
+  if ( ::madvise( map, len, MADV_SEQUENTIAL ) != 0 )
+    ::perror( "madvise" );
+#else
+  HANDLE h = CreateFileA( fn, GENERIC_READ, 0, NULL,
+                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+  LARGE_INTEGER st;
+  if ( h == INVALID_HANDLE_VALUE ) {
+    fprintf( stderr, "err open %s: %ld\n", fn, GetLastError() );
+    return NULL;
+  }
+  GetFileSizeEx( h, &st );
+  len = st.QuadPart;
+  HANDLE maph = CreateFileMappingA( h, NULL, PAGE_READONLY, 0, 0, NULL );
+  if ( maph == NULL ) {
+    fprintf( stderr, "err map %s: %ld\n", fn, GetLastError() );
+    CloseHandle( h );
+    return NULL;
+  }
+  map = MapViewOfFile( maph, FILE_MAP_READ, 0, 0, 0 );
+  if ( map == NULL ) {
+    fprintf( stderr, "err view %s: %ld\n", fn, GetLastError() );
+    CloseHandle( h );
+    CloseHandle( maph );
+    return NULL;
+  }
+  CloseHandle( h );
+  CloseHandle( maph );
+#endif
+  return map;
+}
+
+static void
+unmap_file( void *map,  size_t len )
+{
+#ifndef RDB_WINDOWS
+  ::munmap( map, len );
+#else
+  (void) len;
+  UnmapViewOfFile( map );
+#endif
+}
+
+/* merge each --merge file to out_fn */
+static int
+merge_files( int argc,  char *argv[],  const char *out_fn,
+             const char *conflict )
+{
+  RdbMerge merge;
+  void  ** map = (void **) ::calloc( argc, sizeof( void * ) );
+  size_t * len = (size_t *) ::calloc( argc, sizeof( size_t ) );
+  int      i, status = 1;
+
+  if ( map == NULL || len == NULL ) {
+    ::perror( "calloc" );
+    return 1;
+  }
+  if ( ::strcmp( conflict, "first" ) == 0 )
+    merge.policy = MERGE_FIRST;
+  else if ( ::strcmp( conflict, "last" ) == 0 )
+    merge.policy = MERGE_LAST;
+  else if ( ::strcmp( conflict, "error" ) == 0 )
+    merge.policy = MERGE_ERROR;
+  else {
+    fprintf( stderr, "conflict %s should be first, last or error\n",
+             conflict );
+    goto done;
+  }
+  for ( i = 1; i < argc - 1; i++ ) {
+    if ( ::strcmp( argv[ i ], "--merge" ) == 0 ) {
+      const char * fn = argv[ ++i ];
+      if ( (map[ i ] = map_file( fn, len[ i ] )) == NULL ||
+           ! merge.add_input( (const uint8_t *) map[ i ], len[ i ], fn ) )
+        goto done;
+    }
+  }
+  if ( merge.run( out_fn ) ) {
+    for ( size_t j = 0; j < merge.file_cnt; j++ )
+      fprintf( stderr, "%s: %" PRIu64 " keys merged\n",
+               merge.file[ j ]->in.fn, merge.file[ j ]->in.copy_cnt );
+    fprintf( stderr, "%s: %" PRIu64 " keys, %" PRIu64 " conflicts\n",
+             out_fn, merge.w.key_cnt, merge.dup_cnt );
+    status = 0;
+  }
+  else if ( merge.err != RDB_OK ) {
+    fprintf( stderr, "%s: %s\n", merge.file[ merge.err_idx ]->in.fn,
+             get_err_description( merge.err ) );
+  }
+done:;
+  merge.release();
+  for ( i = 0; i < argc; i++ )
+    if ( map[ i ] != NULL )
+      unmap_file( map[ i ], len[ i ] );
+  ::free( map );
+  ::free( len );
+  return status;
+}
+
+/* print the keys which differ between old_fn and new_fn */
+static int
+diff_files( const char *old_fn,  const char *new_fn,  size_t mem )
+{
+  RdbDiff      diff( mem );
+  const char * fn[ 2 ] = { old_fn, new_fn };
+  int          status  = 1;
+
+  for ( int i = 0; i < 2; i++ ) {
+    size_t     len;
+    void     * map = map_file( fn[ i ], len );
+    RdbErrCode err;
+    if ( map == NULL )
+      return 1;
+    if ( i == 1 )
+      diff.start_new();
+    err = hash_rdb_keys( (const uint8_t *) map, len, diff );
+    unmap_file( map, len );
+    if ( err != RDB_OK ) {
+      fprintf( stderr, "%s: %s\n", fn[ i ], get_err_description( err ) );
+      return 1;
+    }
+    if ( diff.failed )
+      return 1;
+  }
+  if ( diff.finish() ) {
+    fprintf( stderr, "%" PRIu64 " added, %" PRIu64 " removed, %" PRIu64
+             " changed, %" PRIu64 " same\n", diff.add_cnt, diff.rem_cnt,
+             diff.chg_cnt, diff.same_cnt );
+    status = 0;
+  }
+  return status;
+}
+
 static const char *
 get_arg( int argc, char *argv[], int b, const char *f, const char *def )
 {
@@ -147,114 +314,431 @@ get_arg( int argc, char *argv[], int b, const char *f, const char *def )
   return def; /* default value */
 }
 
+/* number with an optional k, m or g suffix, multiples of 1024 */
+static double
+get_rate( const char *s )
+{
+  char * e;
+  double r = ::strtod( s, &e );
+  switch ( *e ) {
+    case 'k': case 'K': return r * 1024.0;
+    case 'm': case 'M': return r * 1024.0 * 1024.0;
+    case 'g': case 'G': return r * 1024.0 * 1024.0 * 1024.0;
+    default:            return r;
+  }
+}
+
+/* seconds with an optional m, h, d or w */
+static int64_t
+get_duration( const char *s )
+{
+  char  * e;
+  int64_t t = ::strtoll( s, &e, 10 );
+  switch ( *e ) {
+    case 's': case 'S': return t;
+    case 'm': case 'M': return t * 60;
+    case 'h': case 'H': return t * 3600;
+    case 'd': case 'D': return t * 24 * 3600;
+    case 'w': case 'W': return t * 7 * 24 * 3600;
+    default:            return *e == '\0' ? t : -1;
+  }
+}
+
 int
 main( int argc, char *argv[] )
 {
   const char * glob     = get_arg( argc, argv, 1, "-e", NULL ),
              * invert   = get_arg( argc, argv, 1, "-v", NULL ),
              * ign_case = get_arg( argc, argv, 0, "-i", NULL ),
+             * pat_file = get_arg( argc, argv, 1, "--pattern-file", NULL ),
+             * key_file = get_arg( argc, argv, 1, "-K", NULL ),
+             * where    = get_arg( argc, argv, 1, "--where", NULL ),
+             * grep_val = get_arg( argc, argv, 1, "--grep-value", NULL ),
+             * grep_re  = get_arg( argc, argv, 1, "--grep-regex", NULL ),
+             * grep_el  = get_arg( argc, argv, 0, "--grep-elem", NULL ),
+             * stats    = get_arg( argc, argv, 0, "--stats", NULL ),
+             * sample   = get_arg( argc, argv, 1, "--sample", NULL ),
+             * every    = get_arg( argc, argv, 1, "--every", NULL ),
+             * top      = get_arg( argc, argv, 1, "--top", NULL ),
+             * memory   = get_arg( argc, argv, 0, "--memory", NULL ),
+             * mem_pre  = get_arg( argc, argv, 1, "--mem-prefix", NULL ),
+             * delim    = get_arg( argc, argv, 1, "--delim", ":" ),
+             * pre_tree = get_arg( argc, argv, 1, "--prefix-tree", NULL ),
+             * tree_max = get_arg( argc, argv, 1, "--tree-nodes", "1000000" ),
+             * ttl      = get_arg( argc, argv, 0, "--ttl", NULL ),
+             * ttl_pre  = get_arg( argc, argv, 1, "--ttl-prefix", NULL ),
+             * exp_win  = get_arg( argc, argv, 1, "--expire-within", NULL ),
              * fn       = get_arg( argc, argv, 1, "-f", NULL ),
              * meta     = get_arg( argc, argv, 0, "-m", NULL ),
              * list     = get_arg( argc, argv, 0, "-l", NULL ),
              * restore  = get_arg( argc, argv, 0, "-r", NULL ),
+             * out_fn   = get_arg( argc, argv, 1, "-o", NULL ),
+             * merge    = get_arg( argc, argv, 1, "--merge", NULL ),
+             * conflict = get_arg( argc, argv, 1, "--conflict", "error" ),
+             * diff_old = get_arg( argc, argv, 1, "--diff", NULL ),
+             * diff_new = get_arg( argc, argv, 2, "--diff", NULL ),
+             * diff_mem = get_arg( argc, argv, 1, "--diff-mem", "1g" ),
+             * prev_rdb = get_arg( argc, argv, 1, "--delta-rdb", NULL ),
+             * prev_idx = get_arg( argc, argv, 1, "--delta-index", NULL ),
+             * save_idx = get_arg( argc, argv, 1, "--save-index", NULL ),
+             * finger   = get_arg( argc, argv, 1, "--fingerprint", NULL ),
+             * tver     = get_arg( argc, argv, 1, "--target-rdb-version", NULL ),
+             * load     = get_arg( argc, argv, 1, "--load", NULL ),
+             * conns    = get_arg( argc, argv, 1, "--conns", "4" ),
+             * window   = get_arg( argc, argv, 1, "--window", "256" ),
+             * rate_b   = get_arg( argc, argv, 1, "--rate-bytes", NULL ),
+             * rate_c   = get_arg( argc, argv, 1, "--rate-cmds", NULL ),
+             * max_lat  = get_arg( argc, argv, 1, "--max-latency", NULL ),
+             * slot_spl = get_arg( argc, argv, 1, "--slot-split", NULL ),
+             * slot_map = get_arg( argc, argv, 1, "--slot-map", NULL ),
+             * slot_pre = get_arg( argc, argv, 1, "--slot-prefix", "restore" ),
              * help     = get_arg( argc, argv, 0, "-h", NULL );
   if ( help != NULL ) {
     printf( "%s [-e pat] [-v] [-i] [-f file]\n"
-            "   -e pat  : match key with glob pattern\n"
+            "   -e pat  : match key with glob pattern, may be repeated\n"
             "   -v      : invert key match\n"
             "   -i      : ignore key match case\n"
+            "   --pattern-file f : match key with glob patterns in f,\n"
+            "                      one per line\n"
+            "   -K file : match keys listed in file, one per line\n"
+            "   --where expr : match keys by type, ttl, expire, db, len,\n"
+            "                  idle, freq, ex: 'type=hash and ttl=none'\n"
+            "   --grep-value s : list keys with a value containing s\n"
+            "   --grep-regex r : list keys with a value matching pcre r\n"
+            "   --grep-elem    : also print the field, member or index\n"
+            "   --stats        : print counts and sizes of keys by type\n"
+            "   --sample r     : decode a sample of keys, ratio r (0.01),\n"
+            "                    the same keys are sampled by each run,\n"
+            "                    stats are estimated when used\n"
+            "   --every N      : decode every Nth key, like --sample\n"
+            "   --top K        : with stats, the K largest keys of each\n"
+            "                    type and the K hot and cold keys\n"
+            "   --memory       : print the memory estimated for each key\n"
+            "                    as loaded by redis, db, key, type,\n"
+            "                    encoding, elems, memory, encoded bytes\n"
+            "   --mem-prefix N : sum the memory by key prefix, up to N\n"
+            "                    delimiters, instead of each key\n"
+            "   --delim c      : key prefix delimiter (:)\n"
+            "   --prefix-tree N : print keys, sizes, elems and ttl of the\n"
+            "                     key prefixes, up to N delimiters deep\n"
+            "   --tree-nodes N  : collapse the smallest prefixes when the\n"
+            "                     tree has N nodes (1000000)\n"
+            "   --ttl          : print keys and bytes by time to expire,\n"
+            "                    by type and key prefix\n"
+            "   --ttl-prefix N : --ttl prefix is up to N delimiters (1)\n"
+            "   --expire-within t : match keys which expire within t\n"
+            "                       seconds, or t[m|h|d|w]\n"
             "   -f file : dump rdb file to read\n"
             "   -m      : show meta data in json output\n"
             "   -l      : list keys which match\n"
             "   -r      : write restore commands | redis-cli --pipe\n"
+            "   -o file : copy matching keys to a new rdb file, with\n"
+            "             slot split or map, files are file.range.rdb\n"
+            "             or file.node.rdb\n"
+            "   --merge file : merge rdb file to -o file, may be repeated\n"
+            "   --conflict p : key in more than one merge file is an error,\n"
+            "                  or first or last file wins (error)\n"
+            "   --diff old new   : print keys added (+), removed (-) or\n"
+            "                      changed (~) between two rdb files\n"
+            "   --diff-mem N     : memory used by diff before spilling (1g)\n"
+            "   --delta-rdb old  : restore only keys changed since old rdb,\n"
+            "                      and DEL keys removed\n"
+            "   --delta-index i  : same, using an index saved from old\n"
+            "   --save-index i   : save an index of keys for the next delta,\n"
+            "                      the delta options can't be filtered\n"
+            "   --fingerprint f  : print db, key, type, length and hash of\n"
+            "                      each key, f is tsv or bin (an index)\n"
+            "   --target-rdb-version N : transcode restore data for rdb N\n"
+            "   --load addr : restore to host:port or unix socket path\n"
+            "   --conns N   : number of connections used by load (4)\n"
+            "   --window N  : restores in flight per connection (256)\n"
+            "   --rate-bytes N   : limit restores to N[k|m|g] bytes/sec\n"
+            "   --rate-cmds N    : limit restores to N commands/sec\n"
+            "   --max-latency ms : load adapts window to reply latency\n"
+            "   --slot-split N   : split restores or -o into N files by slot\n"
+            "   --slot-map file  : split restores or -o by node, the\n"
+            "                      map lines are: start[-end] node\n"
+            "   --slot-prefix p  : slot files are p.range.resp or p.node.resp\n"
             "default is to print json of matching data\n"
             "if no file is given, will read data from stdin\n", argv[ 0 ] );
     return 0;
   }
 
-  RdbDecode  decode;
-  PcreFilter pcre_filter( decode );
-  void     * map = NULL;
+  if ( diff_old != NULL ) {
+    if ( diff_new == NULL ) {
+      fprintf( stderr, "--diff requires two files\n" );
+      return 1;
+    }
+    return diff_files( diff_old, diff_new, (size_t) get_rate( diff_mem ) );
+  }
+  if ( merge != NULL ) {
+    if ( out_fn == NULL ) {
+      fprintf( stderr, "--merge requires -o file\n" );
+      return 1;
+    }
+    return merge_files( argc, argv, out_fn, conflict );
+  }
+
+  RdbDecode        decode;
+  PcreFilter       pcre_filter( decode );
+  RdbKeyListFilter key_filter( decode );
+  RdbWhereFilter   where_filter( decode );
+  RdbSampleFilter  sample_filter( decode );
+  void           * map = NULL;
 
   /* set up key filter */
-  if ( glob != NULL ) {
-    if ( ! pcre_filter.set_filter_expr( glob, ::strlen( glob ),
+  if ( key_file != NULL ) {
+    if ( glob != NULL || pat_file != NULL ) {
+      fprintf( stderr, "-K can't be used with -e or --pattern-file\n" );
+      return 1;
+    }
+    if ( ! key_filter.load( key_file, ( ign_case != NULL ),
+                            ( invert != NULL ) ) )
+      return 1;
+    decode.filter = &key_filter;
+  }
+  else if ( glob != NULL || pat_file != NULL ) {
+    int  glob_cnt = 0;
+    bool ok = true;
+    for ( int i = 1; i < argc - 1; i++ )
+      if ( ::strcmp( argv[ i ], "-e" ) == 0 )
+        glob_cnt++;
+    if ( glob_cnt == 1 && pat_file == NULL )
+      ok = pcre_filter.set_filter_expr( glob, ::strlen( glob ),
                                         ( ign_case != NULL ),
-                                        ( invert != NULL ) ) ) {
+                                        ( invert != NULL ) );
+    else {
+      /* multiple patterns are compiled into one alternation */
+      for ( int i = 1; ok && i < argc - 1; i++ ) {
+        if ( ::strcmp( argv[ i ], "-e" ) == 0 ) {
+          const char * pat = argv[ ++i ];
+          ok = pcre_filter.add_filter_expr( pat, ::strlen( pat ),
+                                            ( ign_case != NULL ) );
+        }
+      }
+      if ( ok && pat_file != NULL )
+        ok = pcre_filter.add_filter_file( pat_file, ( ign_case != NULL ) );
+      if ( ok )
+        ok = pcre_filter.compile_filter( invert != NULL );
+    }
+    if ( ! ok ) {
       fprintf( stderr, "pcre filter failed\n" );
       return 1;
     }
     decode.filter = &pcre_filter;
   }
+  /* header predicates are checked before the key filter */
+  if ( where != NULL || exp_win != NULL ) {
+    if ( where != NULL && ! where_filter.parse( where ) )
+      return 1;
+    if ( exp_win != NULL ) {
+      int64_t t = get_duration( exp_win );
+      if ( t <= 0 ) {
+        fprintf( stderr, "--expire-within requires a time > 0\n" );
+        return 1;
+      }
+      if ( ! where_filter.add_pred( WHERE_TTL, WHERE_GE, 0 ) ||
+           ! where_filter.add_pred( WHERE_TTL, WHERE_LT, t ) )
+        return 1;
+    }
+    where_filter.next = decode.filter;
+    decode.filter     = &where_filter;
+  }
+  /* sample the keys matched by the other filters */
+  if ( sample != NULL || every != NULL ) {
+    if ( every != NULL )
+      sample_filter.set_every( (uint64_t) ::strtoull( every, NULL, 10 ) );
+    else if ( ! sample_filter.set_rate( ::strtod( sample, NULL ) ) )
+      return 1;
+    sample_filter.next = decode.filter;
+    decode.filter      = &sample_filter;
+  }
 
   /* map the file, if filename given */
   if ( fn != NULL ) {
-#ifndef RDB_WINDOWS
-    int fd = ::open( fn, O_RDONLY );
-    struct stat st;
-    if ( fd < 0 ) {
-      ::perror( fn );
+    if ( (map = map_file( fn, input_off )) == NULL )
       return 1;
-    }
-    if ( ::fstat( fd, &st ) != 0 ) {
-      ::perror( "fstat" );
-      ::close( fd );
+    input_buf = (uint8_t *) map;
+  }
+  /* load stdin buffer */
+  else {
+    fill_buf_stdin();
+  }
+
+  RdbBufptr        bptr( input_buf, input_off );
+  JsonOutput       json_out( decode );
+  ListOutput       list_out( decode );
+  RestoreOutput    rest_out( decode, bptr, true );
+  RestoreLoader    loader;
+  RdbSlotMap       slots;
+  RestoreSlotSplit slot_out( slots );
+  RdbCopyOutput    copy_out( decode, bptr, out_fn );
+  RdbDelta         delta;
+  RdbFingerprint   fp_sink( finger != NULL && ::strcmp( finger, "bin" ) == 0 );
+  RdbHashOutput    hash_out( decode, bptr, &fp_sink );
+  GrepOutput       grep_out( decode, bptr );
+  RdbStatsOutput   stats_out( decode, bptr );
+  RdbMemOutput     mem_out( decode, bptr );
+  RdbPrefixOutput  tree_out( decode, bptr );
+  RdbTtlOutput     ttl_out( decode, bptr );
+  int              status = 0;
+
+  if ( tver != NULL ) {
+    if ( ! rest_out.set_target_version( (uint16_t) ::atoi( tver ) ) ) {
+      fprintf( stderr, "target rdb version %s not supported\n", tver );
       return 1;
     }
-    input_off = st.st_size;
-    map = ::mmap( 0, input_off, PROT_READ, MAP_SHARED, fd, 0 );
-    if ( map == MAP_FAILED ) {
-      ::perror( "mmap" );
-      ::close( fd );
+  }
+
+  /* pace restores */
+  if ( rate_b != NULL || rate_c != NULL )
+    rest_out.pace.set_rate( rate_b != NULL ? get_rate( rate_b ) : 0,
+                            rate_c != NULL ? get_rate( rate_c ) : 0 );
+  /* connect and send restores directly to the server */
+  if ( load != NULL ) {
+    if ( ! loader.connect( load, (size_t) ::atoi( conns ),
+                           (size_t) ::atoi( window ) ) )
+      return 1;
+    if ( max_lat != NULL )
+      loader.max_lat_us = (uint64_t) ( ::strtod( max_lat, NULL ) * 1000.0 );
+    rest_out.sink = &loader;
+  }
+
+  /* split restores or rdb output into files by cluster hash slot */
+  if ( slot_spl != NULL || slot_map != NULL ) {
+    if ( load != NULL ) {
+      fprintf( stderr, "--load can't be used with slot files\n" );
       return 1;
     }
-    ::close( fd );
-    if ( ::madvise( map, input_off, MADV_SEQUENTIAL ) != 0 )
-      ::perror( "madvise" );
-#else
-    HANDLE h = CreateFileA( fn, GENERIC_READ, 0, NULL,
-                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
-    LARGE_INTEGER st;
-    if ( h == INVALID_HANDLE_VALUE ) {
-      fprintf( stderr, "err open %s: %ld\n", fn, GetLastError() );
+    if ( slot_map != NULL ) {
+      if ( ! slots.load( slot_map ) )
+        return 1;
+    }
+    else if ( ! slots.split( (size_t) ::atoi( slot_spl ) ) )
       return 1;
+    if ( out_fn != NULL )
+      copy_out.map = &slots;
+    else {
+      if ( ! slot_out.open( slot_pre ) )
+        return 1;
+      rest_out.sink = &slot_out;
     }
-    GetFileSizeEx( h, &st );
-    input_off = st.QuadPart;
-    HANDLE maph = CreateFileMappingA( h, NULL, PAGE_READONLY, 0, 0, NULL );
-    if ( maph == NULL ) {
-      fprintf( stderr, "err map %s: %ld\n", fn, GetLastError() );
-      CloseHandle( h );
+  }
+
+  /* restore keys which differ from the previous snapshot */
+  if ( prev_rdb != NULL || prev_idx != NULL || save_idx != NULL ) {
+    /* the old keys outside of the filter would look removed and be deleted */
+    if ( decode.filter != NULL ) {
+      fprintf( stderr, "--delta-rdb, --delta-index and --save-index can't "
+               "be used with a key filter\n" );
       return 1;
     }
-    map = MapViewOfFile( maph, FILE_MAP_READ, 0, 0, 0 );
-    if ( map == NULL ) {
-      fprintf( stderr, "err view %s: %ld\n", fn, GetLastError() );
-      CloseHandle( h );
-      CloseHandle( maph );
+    if ( prev_rdb != NULL ) {
+      size_t     len;
+      void     * prev = map_file( prev_rdb, len );
+      RdbErrCode err;
+      if ( prev == NULL )
+        return 1;
+      err = hash_rdb_keys( (const uint8_t *) prev, len, delta );
+      unmap_file( prev, len );
+      if ( err != RDB_OK ) {
+        fprintf( stderr, "%s: %s\n", prev_rdb, get_err_description( err ) );
+        return 1;
+      }
+    }
+    else if ( prev_idx != NULL ) {
+      if ( ! delta.load_index( prev_idx ) )
+        return 1;
+    }
+    delta.start_new();
+    if ( save_idx != NULL && ! delta.open_index( save_idx ) )
+      return 1;
+    if ( delta.failed )
+      return 1;
+    delta.out      = &rest_out;
+    rest_out.delta = &delta;
+  }
+
+  /* set up the output */
+  if ( finger != NULL ) {
+    if ( ! fp_sink.is_binary && ::strcmp( finger, "tsv" ) != 0 ) {
+      fprintf( stderr, "--fingerprint is tsv or bin\n" );
       return 1;
     }
-    CloseHandle( h );
-    CloseHandle( maph );
+#ifdef RDB_WINDOWS
+    if ( fp_sink.is_binary )
+      freopen( NULL, "wb", stdout );
 #endif
-    input_buf = (uint8_t *) map;
+    if ( ! fp_sink.start() )
+      return 1;
+    decode.data_out = &hash_out;
+    decode.is_skip  = true; /* only the raw bytes are hashed */
   }
-  /* load stdin buffer */
-  else {
-    fill_buf_stdin();
+  else if ( grep_val != NULL || grep_re != NULL ) {
+    const char * needle = ( grep_re != NULL ? grep_re : grep_val );
+    if ( ! grep_out.set_needle( needle, ::strlen( needle ),
+                                grep_re != NULL ) )
+      return 1;
+    grep_out.show_elem = ( grep_el != NULL );
+    decode.data_out = &grep_out;
   }
-
-  RdbBufptr     bptr( input_buf, input_off );
-  JsonOutput    json_out( decode );
-  ListOutput    list_out( decode );
-  RestoreOutput rest_out( decode, bptr, true );
-
-  /* set up the output */
-  if ( list != NULL )
+  else if ( ( memory != NULL || mem_pre != NULL || pre_tree != NULL ||
+              ttl != NULL || ttl_pre != NULL ) && ::strlen( delim ) != 1 ) {
+    fprintf( stderr, "--delim requires one character\n" );
+    return 1;
+  }
+  else if ( ttl != NULL || ttl_pre != NULL ) {
+    if ( ! ttl_out.set_prefix( delim[ 0 ], ttl_pre == NULL ? 1 :
+                               (size_t) ::atol( ttl_pre ) ) )
+      return 1;
+    decode.data_out = &ttl_out;
+    decode.is_skip  = true; /* only the sizes are needed */
+  }
+  else if ( pre_tree != NULL ) {
+    if ( ! tree_out.tree.init( delim[ 0 ], (size_t) ::atol( pre_tree ),
+                               (size_t) ::atol( tree_max ) ) )
+      return 1;
+    decode.data_out = &tree_out;
+  }
+  else if ( memory != NULL || mem_pre != NULL ) {
+    if ( mem_pre != NULL ) {
+      if ( ! mem_out.set_prefix( delim[ 0 ], (size_t) ::atol( mem_pre ) ) )
+        return 1;
+    }
+    decode.data_out = &mem_out;
+  }
+  else if ( list != NULL )
     decode.data_out = &list_out;
-  else if ( restore != NULL ) {
+  else if ( stats != NULL || top != NULL ||
+            ( decode.filter == &sample_filter && out_fn == NULL &&
+              restore == NULL && rest_out.sink == NULL &&
+              rest_out.delta == NULL ) ) {
+    if ( decode.filter == &sample_filter )
+      stats_out.sample = &sample_filter;
+    if ( top != NULL ) {
+      long k = ::atol( top );
+      if ( k <= 0 ) {
+        fprintf( stderr, "--top requires a count > 0\n" );
+        return 1;
+      }
+      if ( ! stats_out.set_top( (size_t) k ) )
+        return 1;
+    }
+    decode.data_out = &stats_out;
+  }
+  else if ( out_fn != NULL ) {
+    decode.data_out = &copy_out;
+    decode.is_skip  = true; /* the records are copied as they are */
+  }
+  else if ( rest_out.sink != NULL )
+    decode.data_out = &rest_out;
+  else if ( restore != NULL || rest_out.delta != NULL ) {
 #ifdef RDB_WINDOWS
     freopen( NULL, "wb", stdout );
+#else
+    /* mapped input can be spliced into a pipe without copying */
+    if ( map != NULL )
+      rest_out.init_splice( STDOUT_FILENO );
 #endif
     decode.data_out = &rest_out;
   }
@@ -267,8 +751,14 @@ main( int argc, char *argv[] )
   /* loop through the keys */
   for (;;) {
     RdbErrCode err = decode.decode_hdr( bptr ); /* find type, length and key */
-    if ( err == RDB_OK )
-      err = decode.decode_body( bptr );         /* decode the data type */
+    if ( err == RDB_OK ) {
+      if ( decode.data_out == &grep_out )
+        grep_out.check_blob();                  /* search the raw value */
+      if ( decode.is_skip )
+        err = decode.skip_body( bptr );         /* skip over the value */
+      else
+        err = decode.decode_body( bptr );       /* decode the data type */
+    }
     if ( err != RDB_OK ) {
       if ( err == RDB_EOF_MARK )             /* 0xff marker found */
         goto break_loop;
@@ -278,11 +768,27 @@ main( int argc, char *argv[] )
       return 1;
     }
     decode.key_cnt++;
+    /* the top keys are copied from the key, which may be unzipped */
+    if ( decode.data_out == &stats_out )
+      stats_out.end_key();
     /* release lzf decompress allocations */
     if ( bptr.alloced_mem != NULL )
       bptr.free_alloced();
-    if ( decode.data_out == &rest_out )
+    if ( decode.data_out == &rest_out ) {
       rest_out.write_restore_cmd();
+      if ( loader.failed )
+        return 1;
+    }
+    else if ( decode.data_out == &copy_out ) {
+      copy_out.copy_key();
+      if ( copy_out.failed )
+        return 1;
+    }
+    else if ( decode.data_out == &hash_out ) {
+      hash_out.hash_key();
+      if ( fp_sink.failed )
+        return 1;
+    }
     /* fill more buffer from stdin */
     if ( ! input_eof && bptr.offset > input_buf_size / 2 ) {
       ::memmove( input_buf, bptr.buf, bptr.avail );
@@ -298,14 +804,60 @@ main( int argc, char *argv[] )
   }
 break_loop:;
   decode.data_out->d_finish( true );
-#ifndef RDB_WINDOWS
-  if ( map != NULL )
-    ::munmap( map, input_off );
-#else
+  if ( decode.data_out == &rest_out && rest_out.delta != NULL ) {
+    if ( ! delta.finish_delta() )
+      status = 1;
+    if ( rest_out.sink == NULL )
+      fflush( stdout );
+    fprintf( stderr, "%" PRIu64 " added, %" PRIu64 " changed, %" PRIu64
+             " unchanged, %" PRIu64 " deleted\n", delta.add_cnt,
+             delta.chg_cnt, rest_out.same_cnt, rest_out.del_cnt );
+  }
+  if ( decode.data_out == &rest_out &&
+       ( rest_out.expired_cnt != 0 || rest_out.notsup_cnt != 0 ) ) {
+    fflush( stdout );
+    fprintf( stderr, "%" PRIu64 " keys dropped already expired, %" PRIu64
+             " keys dropped not loadable by target\n", rest_out.expired_cnt,
+             rest_out.notsup_cnt );
+  }
+  if ( load != NULL ) {
+    bool ok = loader.drain();
+    uint64_t replies = loader.ok_cnt + loader.err_cnt;
+    fprintf( stderr, "%" PRIu64 " keys restored, %" PRIu64 " errors, "
+             "%.3f ms avg latency, window %" PRIu64 "\n",
+             loader.ok_cnt, loader.err_cnt,
+             replies ? (double) loader.lat_sum / (double) replies / 1000.0 : 0,
+             (uint64_t) loader.win_cur );
+    if ( ! ok || loader.err_cnt != 0 )
+      status = 1;
+  }
+  if ( decode.data_out == &grep_out ) {
+    fflush( stdout );
+    fprintf( stderr, "%" PRIu64 " keys matched, %" PRIu64 " values skipped"
+             " without decoding\n", grep_out.key_cnt, grep_out.skip_cnt );
+  }
+  if ( decode.data_out == &copy_out ) {
+    if ( copy_out.failed )
+      status = 1;
+    else if ( copy_out.map != NULL ) {
+      for ( size_t i = 0; i < copy_out.file_cnt; i++ )
+        fprintf( stderr, "%s: %" PRIu64 " keys\n", copy_out.file[ i ].fn,
+                 copy_out.file[ i ].copy_cnt );
+    }
+    else
+      fprintf( stderr, "%s: %" PRIu64 " of %" PRIu64 " keys copied\n", out_fn,
+               copy_out.copy_cnt, decode.key_cnt );
+  }
+  if ( rest_out.sink == &slot_out ) {
+    for ( size_t i = 0; i < slots.out_cnt; i++ )
+      fprintf( stderr, "%s.%s.resp: %" PRIu64 " keys\n", slot_pre,
+               slots.name[ i ], slot_out.key_cnt[ i ] );
+    if ( ! slot_out.close() )
+      status = 1;
+  }
   if ( map != NULL )
-    UnmapViewOfFile( map );
-#endif
+    unmap_file( map, input_off );
   else if ( input_buf != big_buf )
     ::free( input_buf );
-  return 0;
+  return status;
 }
@@ -0,0 +1,514 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <rdbparser/rdb_decode.h>
+#include <rdbparser/rdb_json.h>
+#include <rdbparser/rdb_where.h>
+#include <rdbparser/rdb_memory.h>
+
+using namespace rdbparser;
+
+static const char *mem_type_name[] = {
+  "string", "list", "set", "zset", "hash", "stream", "module", "unknown"
+};
+
+static const char *mem_enc_name[] = {
+  "int", "embstr", "raw", "listpack", "quicklist", "intset", "hashtable",
+  "skiplist", "stream", "module"
+};
+
+/* sizes of the redis structures on a 64 bit server */
+static const uint64_t ROBJ_SIZE       = 16, /* robj */
+                      DICT_SIZE       = 56, /* dict */
+                      DICT_ENTRY_SIZE = 24, /* dictEntry */
+                      QUICKLIST_SIZE  = 40, /* quicklist */
+                      QL_NODE_SIZE    = 32, /* quicklistNode */
+                      ZSET_SIZE       = 16, /* zset, dict + zskiplist */
+                      ZSL_SIZE        = 32, /* zskiplist */
+                      ZSL_NODE_SIZE   = 24, /* zskiplistNode, + 16 per level */
+                      ZSL_MAX_LEVEL   = 32,
+                      STREAM_SIZE     = 104,/* stream */
+                      LP_HDR_SIZE     = 7,  /* listpack header + end */
+                      INTSET_HDR_SIZE = 8;  /* intset header */
+
+RdbMemOutput::RdbMemOutput( RdbDecode &dec,  RdbBufptr &b ) noexcept
+  : RdbOutput( dec ), bptr( b ), pre( 0 ), pre_size( 0 ), type_off( 0 ),
+    elems( 0 ), lp_bytes( 0 ), sds_bytes( 0 ), max_len( 0 ), node_bytes( 0 ),
+    node_mem( 0 ), nodes( 0 ), str_mem( 0 ), zsl_node( 0 ), key_cnt( 0 ),
+    mem_total( 0 ), enc_total( 0 ), int_min( 0 ), int_max( 0 ),
+    str_enc( ENC_RAW ), all_int( true ), failed( false )
+{
+  /* the level of a skiplist node is 1 + 0.25 probability of each next */
+  double avg = 0, p = 0.75;
+  for ( uint64_t l = 1; l <= ZSL_MAX_LEVEL; l++ ) {
+    avg += p * (double) alloc_size( ZSL_NODE_SIZE + l * 16 );
+    p   *= 0.25;
+  }
+  this->zsl_node = (uint64_t) ( avg + 0.5 );
+}
+
+RdbMemOutput::~RdbMemOutput() noexcept
+{
+  if ( this->pre != NULL )
+    ::free( this->pre );
+}
+
+bool
+RdbMemOutput::set_prefix( char c,  size_t d ) noexcept
+{
+  return this->prefix.init( c, d );
+}
+
+uint64_t
+RdbMemOutput::alloc_size( uint64_t n ) noexcept
+{
+  /* jemalloc: 8, then 16 byte steps to 128, then 4 classes per doubling */
+  if ( n <= 8 )
+    return 8;
+  if ( n <= 128 )
+    return ( n + 15 ) & ~(uint64_t) 15;
+  int b = 63;
+  while ( ( ( n - 1 ) >> b ) == 0 )
+    b--;
+  uint64_t step = (uint64_t) 1 << ( b - 2 );
+  return ( n + step - 1 ) & ~( step - 1 );
+}
+
+uint64_t
+RdbMemOutput::sds_size( uint64_t len ) noexcept
+{
+  uint64_t hdr = ( len < 32 ? 1 : len < 256 ? 3 : len < 65536 ? 5 :
+                   len < ( (uint64_t) 1 << 32 ) ? 9 : 17 );
+  return alloc_size( hdr + len + 1 );
+}
+
+uint64_t
+RdbMemOutput::dict_size( uint64_t n ) noexcept
+{
+  uint64_t buckets = 4;
+  while ( buckets < n )
+    buckets *= 2;
+  return alloc_size( DICT_SIZE ) + alloc_size( buckets * 8 ) +
+         n * alloc_size( DICT_ENTRY_SIZE );
+}
+
+bool
+RdbMemOutput::str_int( const RdbString &s,  int64_t &ival ) noexcept
+{
+  switch ( s.coding ) {
+    case RDB_INT_VAL:
+      ival = s.ival;
+      return true;
+    case RDB_DBL_VAL:
+      if ( s.fval < -9.2e18 || s.fval > 9.2e18 ||
+           s.fval != (double) (int64_t) s.fval )
+        return false;
+      ival = (int64_t) s.fval;
+      return true;
+    case RDB_STR_VAL: {
+      /* same as string2ll(), no leading zeros or plus */
+      const char * p = s.s;
+      size_t       n = s.s_len, i = 0;
+      uint64_t     v = 0;
+      bool         neg = false;
+      if ( n == 0 || n > 20 )
+        return false;
+      if ( p[ 0 ] == '-' ) {
+        neg = true;
+        if ( ++i == n )
+          return false;
+      }
+      if ( p[ i ] == '0' && n > 1 )
+        return false;
+      for ( ; i < n; i++ ) {
+        if ( p[ i ] < '0' || p[ i ] > '9' )
+          return false;
+        uint64_t d = (uint64_t) ( p[ i ] - '0' );
+        if ( v > ( ~(uint64_t) 0 - d ) / 10 )
+          return false;
+        v = v * 10 + d;
+      }
+      if ( neg ) {
+        if ( v > (uint64_t) 1 << 63 )
+          return false;
+        ival = (int64_t) ( 0 - v );
+      }
+      else {
+        if ( v > (uint64_t) INT64_MAX )
+          return false;
+        ival = (int64_t) v;
+      }
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+uint64_t
+RdbMemOutput::str_len( const RdbString &s ) noexcept
+{
+  char buf[ 32 ];
+  switch ( s.coding ) {
+    case RDB_STR_VAL:
+      return s.s_len;
+    case RDB_INT_VAL:
+      return (uint64_t) snprintf( buf, sizeof( buf ), "%" PRId64, s.ival );
+    case RDB_DBL_VAL:
+      return (uint64_t) snprintf( buf, sizeof( buf ), "%.17g", s.fval );
+    default:
+      return 0;
+  }
+}
+
+uint64_t
+RdbMemOutput::lp_entry_size( const RdbString &s ) noexcept
+{
+  int64_t  ival;
+  uint64_t len, sz;
+
+  if ( str_int( s, ival ) ) {
+    /* encoding + int, then 1 byte backlen */
+    if ( ival >= 0 && ival <= 127 )
+      return 2;
+    if ( ival >= -4096 && ival <= 4095 )
+      return 3;
+    if ( ival >= INT16_MIN && ival <= INT16_MAX )
+      return 4;
+    if ( ival >= -( 1 << 23 ) && ival < ( 1 << 23 ) )
+      return 5;
+    if ( ival >= INT32_MIN && ival <= INT32_MAX )
+      return 6;
+    return 10;
+  }
+  len = str_len( s );
+  sz  = ( len < 64 ? 1 : len < 4096 ? 2 : 5 ) + len;
+  /* backlen is 7 bits per byte */
+  return sz + ( sz < 128 ? 1 : sz < 16384 ? 2 : sz < 2097152 ? 3 :
+                sz < 268435456 ? 4 : 5 );
+}
+
+const char *
+RdbMemOutput::enc_name( MemEnc enc ) noexcept
+{
+  return mem_enc_name[ enc ];
+}
+
+void
+RdbMemOutput::d_start_type( RdbType ) noexcept
+{
+  this->type_off = this->stream_offset();
+}
+
+void
+RdbMemOutput::d_start_key( void ) noexcept
+{
+  this->elems      = 0;
+  this->lp_bytes   = 0;
+  this->sds_bytes  = 0;
+  this->max_len    = 0;
+  this->node_bytes = 0;
+  this->node_mem   = 0;
+  this->nodes      = 0;
+  this->str_mem    = 0;
+  this->int_min    = 0;
+  this->int_max    = 0;
+  this->str_enc    = ENC_RAW;
+  this->all_int    = true;
+}
+
+void
+RdbMemOutput::add_elem( const RdbString &s,  bool is_sds ) noexcept
+{
+  int64_t  ival;
+  uint64_t len = str_len( s );
+
+  this->lp_bytes += lp_entry_size( s );
+  if ( ! is_sds )
+    return;
+  this->sds_bytes += sds_size( len );
+  if ( len > this->max_len )
+    this->max_len = len;
+  if ( this->all_int ) {
+    if ( ! str_int( s, ival ) )
+      this->all_int = false;
+    else {
+      if ( ival < this->int_min )
+        this->int_min = ival;
+      if ( ival > this->int_max )
+        this->int_max = ival;
+    }
+  }
+}
+
+void
+RdbMemOutput::d_string( const RdbString &str ) noexcept
+{
+  int64_t  ival;
+  uint64_t len;
+
+  this->elems = 1;
+  if ( str_int( str, ival ) ) {
+    this->str_enc = ENC_INT;
+    this->str_mem = ( ival >= 0 && ival < (int64_t) SHARED_INTS ? 0 :
+                      ROBJ_SIZE );
+  }
+  else if ( (len = str_len( str )) <= EMBSTR_MAX ) {
+    /* robj + sdshdr8 in one alloc */
+    this->str_enc = ENC_EMBSTR;
+    this->str_mem = alloc_size( ROBJ_SIZE + 3 + len + 1 );
+  }
+  else {
+    this->str_enc = ENC_RAW;
+    this->str_mem = ROBJ_SIZE + sds_size( len );
+  }
+}
+
+void
+RdbMemOutput::d_module( const RdbString & ) noexcept
+{
+  this->elems++;
+}
+
+void
+RdbMemOutput::d_hash( const RdbHashEntry &h ) noexcept
+{
+  this->elems++;
+  this->add_elem( h.field, true );
+  this->add_elem( h.val, true );
+}
+
+void
+RdbMemOutput::d_list( const RdbListElem &l ) noexcept
+{
+  uint64_t sz = lp_entry_size( l.val );
+  this->elems++;
+  /* fill the list nodes up to the listpack size limit */
+  if ( this->node_bytes > 0 &&
+       LP_HDR_SIZE + this->node_bytes + sz > LIST_NODE_SIZE ) {
+    this->node_mem  += alloc_size( QL_NODE_SIZE ) +
+                       alloc_size( LP_HDR_SIZE + this->node_bytes );
+    this->nodes++;
+    this->node_bytes = 0;
+  }
+  this->node_bytes += sz;
+}
+
+void
+RdbMemOutput::d_set( const RdbSetMember &s ) noexcept
+{
+  this->elems++;
+  this->add_elem( s.member, true );
+}
+
+void
+RdbMemOutput::d_zset( const RdbZSetMember &z ) noexcept
+{
+  this->elems++;
+  this->add_elem( z.member, true );
+  this->add_elem( z.score, false );
+}
+
+void
+RdbMemOutput::d_stream_entry( const RdbStreamEntry & ) noexcept
+{
+  this->elems++;
+}
+
+uint64_t
+RdbMemOutput::value_mem( uint64_t enc_bytes,  MemEnc &enc ) noexcept
+{
+  uint64_t n = this->elems;
+  bool     fits;
+
+  switch ( this->dec.type ) {
+    case RDB_STRING:
+      enc = this->str_enc;
+      return this->str_mem;
+
+    case RDB_LIST:
+    case RDB_LIST_ZIPLIST:
+    case RDB_LIST_QUICKLIST:
+    case RDB_LIST_QUICKLIST_2:
+      /* a list that fits in one node is a listpack */
+      if ( this->nodes == 0 ) {
+        enc = ENC_LISTPACK;
+        return ROBJ_SIZE + alloc_size( LP_HDR_SIZE + this->node_bytes );
+      }
+      enc = ENC_QUICKLIST;
+      return ROBJ_SIZE + alloc_size( QUICKLIST_SIZE ) + this->node_mem +
+             alloc_size( QL_NODE_SIZE ) +
+             alloc_size( LP_HDR_SIZE + this->node_bytes );
+
+    case RDB_SET:
+    case RDB_SET_INTSET:
+      if ( this->dec.type == RDB_SET_INTSET ||
+           ( this->all_int && n <= SET_MAX_INTSET ) ) {
+        uint64_t w = ( this->int_min >= INT16_MIN &&
+                       this->int_max <= INT16_MAX ? 2 :
+                       this->int_min >= INT32_MIN &&
+                       this->int_max <= INT32_MAX ? 4 : 8 );
+        enc = ENC_INTSET;
+        return ROBJ_SIZE + alloc_size( INTSET_HDR_SIZE + n * w );
+      }
+      if ( n <= SET_MAX_ENTRIES && this->max_len <= SET_MAX_VALUE ) {
+        enc = ENC_LISTPACK;
+        return ROBJ_SIZE + alloc_size( LP_HDR_SIZE + this->lp_bytes );
+      }
+      enc = ENC_HASHTABLE;
+      return ROBJ_SIZE + dict_size( n ) + this->sds_bytes;
+
+    case RDB_HASH:
+    case RDB_HASH_ZIPMAP:
+    case RDB_HASH_ZIPLIST:
+    case RDB_HASH_LISTPACK:
+      fits = ( n <= HASH_MAX_ENTRIES && this->max_len <= HASH_MAX_VALUE );
+      if ( fits || this->dec.type != RDB_HASH ) {
+        enc = ENC_LISTPACK;
+        return ROBJ_SIZE + alloc_size( LP_HDR_SIZE + this->lp_bytes );
+      }
+      enc = ENC_HASHTABLE;
+      return ROBJ_SIZE + dict_size( n ) + this->sds_bytes;
+
+    case RDB_ZSET:
+    case RDB_ZSET_2:
+    case RDB_ZSET_ZIPLIST:
+    case RDB_ZSET_LISTPACK:
+      fits = ( n <= ZSET_MAX_ENTRIES && this->max_len <= ZSET_MAX_VALUE );
+      if ( fits || ( this->dec.type != RDB_ZSET &&
+                     this->dec.type != RDB_ZSET_2 ) ) {
+        enc = ENC_LISTPACK;
+        return ROBJ_SIZE + alloc_size( LP_HDR_SIZE + this->lp_bytes );
+      }
+      /* the member sds is shared by the dict and the skiplist */
+      enc = ENC_SKIPLIST;
+      return ROBJ_SIZE + alloc_size( ZSET_SIZE ) + dict_size( n ) +
+             alloc_size( ZSL_SIZE ) +
+             alloc_size( ZSL_NODE_SIZE + ZSL_MAX_LEVEL * 16 ) +
+             n * this->zsl_node + this->sds_bytes;
+
+    case RDB_STREAM_LISTPACK:
+    case RDB_STREAM_LISTPACKS_2:
+      /* the listpacks are loaded as they are in the rdb */
+      enc = ENC_STREAM;
+      return ROBJ_SIZE + alloc_size( STREAM_SIZE ) + enc_bytes;
+
+    default:
+      enc = ENC_MODULE;
+      return ROBJ_SIZE + enc_bytes;
+  }
+}
+
+uint64_t
+RdbMemOutput::key_mem( void ) const noexcept
+{
+  /* keyspace dict entry, bucket and key sds, and the same for expires */
+  uint64_t m = alloc_size( DICT_ENTRY_SIZE ) + 8 +
+               sds_size( str_len( this->dec.key ) );
+  if ( this->dec.expire_ms != 0 )
+    m += alloc_size( DICT_ENTRY_SIZE ) + 8;
+  return m;
+}
+
+void
+RdbMemOutput::d_end_key( void ) noexcept
+{
+  uint64_t enc_bytes = this->stream_offset() - this->type_off;
+  MemEnc   enc;
+  uint64_t mem = this->value_mem( enc_bytes, enc ) + this->key_mem();
+  int      c   = RdbWhereFilter::rdb_type_class( this->dec.type );
+
+  this->key_cnt++;
+  this->mem_total += mem;
+  this->enc_total += enc_bytes;
+  if ( this->prefix.mask != 0 ) {
+    this->add_prefix( mem, enc_bytes );
+    return;
+  }
+  printf( "%" PRIu64 "\t", this->dec.db );
+  print_s( this->dec.key );
+  printf( "\t%s\t%s\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\n",
+          mem_type_name[ c < 0 ? 7 : c ], mem_enc_name[ enc ], this->elems,
+          mem, enc_bytes );
+}
+
+void
+RdbMemOutput::add_prefix( uint64_t mem,  uint64_t enc_bytes ) noexcept
+{
+  size_t idx, cnt = this->prefix.cnt;
+
+  if ( this->failed )
+    return;
+  if ( ! this->prefix.find( this->dec.key, idx ) ) {
+    this->failed = true;
+    return;
+  }
+  if ( idx == cnt ) { /* new prefix */
+    if ( idx == this->pre_size ) {
+      size_t sz = this->prefix.ent_size;
+      RdbMemPrefix * p =
+        (RdbMemPrefix *) ::realloc( this->pre, sz * sizeof( p[ 0 ] ) );
+      if ( p == NULL ) {
+        ::perror( "realloc" );
+        this->failed = true;
+        return;
+      }
+      this->pre      = p;
+      this->pre_size = sz;
+    }
+    ::memset( &this->pre[ idx ], 0, sizeof( this->pre[ idx ] ) );
+    this->pre[ idx ].idx = idx;
+  }
+  RdbMemPrefix & p = this->pre[ idx ];
+  p.keys++;
+  p.mem += mem;
+  p.enc += enc_bytes;
+}
+
+static int
+cmp_prefix( const void *a,  const void *b )
+{
+  uint64_t x = ( (const RdbMemPrefix *) a )->mem,
+           y = ( (const RdbMemPrefix *) b )->mem;
+  return x > y ? -1 : x < y ? 1 : 0;
+}
+
+void
+RdbMemOutput::print_prefix( void ) noexcept
+{
+  size_t i, n = this->prefix.cnt;
+
+  ::qsort( this->pre, n, sizeof( RdbMemPrefix ), cmp_prefix );
+  printf( "%14s %16s %7s %16s %6s prefix\n", "keys", "memory", "mem%",
+          "enc_bytes", "ratio" );
+  for ( i = 0; i < n; i++ ) {
+    const RdbMemPrefix & p = this->pre[ i ];
+    RdbString s;
+    s.set( this->prefix.prefix( p.idx ), this->prefix.ent[ p.idx ].len );
+    printf( "%14" PRIu64 " %16" PRIu64 " %6.2f%% %16" PRIu64 " %6.2f ",
+            p.keys, p.mem,
+            this->mem_total ? 100.0 * (double) p.mem /
+                              (double) this->mem_total : 0,
+            p.enc, p.enc ? (double) p.mem / (double) p.enc : 0 );
+    print_s( s );
+    printf( "\n" );
+  }
+}
+
+void
+RdbMemOutput::d_finish( bool success ) noexcept
+{
+  if ( ! success )
+    return;
+  if ( this->prefix.mask != 0 && ! this->failed )
+    this->print_prefix();
+  fflush( stdout );
+  fprintf( stderr, "%" PRIu64 " keys, estimated memory %" PRIu64 " bytes, "
+           "encoded %" PRIu64 " bytes (%.2fx)\n", this->key_cnt,
+           this->mem_total, this->enc_total,
+           this->enc_total ? (double) this->mem_total /
+                             (double) this->enc_total : 0 );
+}
@@ -4,28 +4,102 @@
 #include <stdlib.h>
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
+#include <new>
 #include <rdbparser/rdb_decode.h>
 #include <rdbparser/rdb_pcre.h>
 #include <rdbparser/glob_cvt.h>
+#ifdef RDB_USE_PCRE
 #define PCRE2_CODE_UNIT_WIDTH 8
 #include <pcre2.h>
+#endif
 
 #ifdef _MSC_VER
 #define strncasecmp _strnicmp
 #endif
 using namespace rdbparser;
 
+#ifdef RDB_USE_PCRE
 bool
-PcreFilter::set_filter_expr( const char *expr,  size_t expr_len,
-                             bool ign_case,  bool inv ) noexcept
+PcreFilter::compile_re( const uint8_t *pat,  size_t len ) noexcept
 {
   pcre2_real_code_8       * re = NULL;
   pcre2_real_match_data_8 * md = NULL;
-  size_t  erroff = 0;
-  int     error  = 0;
-  uint8_t patbuf[ 1024 ];
-  GlobCvt<uint8_t> gl( patbuf, sizeof( patbuf ) );
+  size_t erroff = 0;
+  int    error  = 0;
 
+  re = pcre2_compile( pat, len, 0, &error, &erroff, 0 );
+  if ( re != NULL ) {
+    md = pcre2_match_data_create_from_pattern( re, NULL );
+    if ( md == NULL ) {
+      pcre2_code_free( re );
+      re = NULL;
+    }
+  }
+  if ( re == NULL ) {
+    fprintf( stderr, "pcre(%d,%" PRId64 "): %.*s\n", error, erroff,
+             (int) len, (const char *) pat );
+    return false;
+  }
+  /* jit is optional, pcre2_match() interprets when not available */
+  this->is_jit = ( pcre2_jit_compile( re, PCRE2_JIT_COMPLETE ) == 0 );
+  /* wildcard key filter */
+  this->re = re;
+  this->md = md;
+  this->name_len = 0;
+  return true;
+}
+#endif
+
+bool
+PcreFilter::add_glob_alt( const char *expr,  size_t expr_len,
+                          bool ign_case ) noexcept
+{
+  size_t i, start = 0;
+  bool   inside_bracket = false;
+
+  for ( i = 0; ; i++ ) {
+    if ( i < expr_len ) { /* split at a | which is not escaped or in [] */
+      char c = expr[ i ];
+      if ( c == '\\' && i + 1 < expr_len ) {
+        i++;
+        continue;
+      }
+      if ( inside_bracket ) {
+        if ( c == ']' )
+          inside_bracket = false;
+        continue;
+      }
+      if ( c == '[' )
+        inside_bracket = true;
+      if ( c != '|' )
+        continue;
+    }
+    RdbGlob ** p = (RdbGlob **)
+      ::realloc( this->glob_alt, sizeof( p[ 0 ] ) * ( this->glob_cnt + 1 ) );
+    void     * m = ( p != NULL ? ::malloc( sizeof( RdbGlob ) ) : NULL );
+    if ( m == NULL ) {
+      ::perror( "malloc" );
+      if ( p != NULL )
+        this->glob_alt = p;
+      return false;
+    }
+    this->glob_alt = p;
+    RdbGlob & g = *( p[ this->glob_cnt++ ] = new ( m ) RdbGlob() );
+    if ( ! g.compile( &expr[ start ], i - start, ign_case ) ) {
+      fprintf( stderr, "bad glob: %.*s\n", (int) ( i - start ),
+               &expr[ start ] );
+      return false;
+    }
+    if ( i >= expr_len )
+      return true;
+    start = i + 1;
+  }
+}
+
+bool
+PcreFilter::set_filter_expr( const char *expr,  size_t expr_len,
+                             bool ign_case,  bool inv ) noexcept
+{
   this->invert      = inv;
   this->ignore_case = ign_case;
 
@@ -34,30 +108,27 @@ PcreFilter::set_filter_expr( const char *expr,  size_t expr_len,
        ::memchr( expr, '?', expr_len ) != NULL ||
        ::memchr( expr, '[', expr_len ) != NULL ||
        ::memchr( expr, '|', expr_len ) != NULL ) {
+    /* without alternation, the glob is matched directly */
+    if ( ::memchr( expr, '|', expr_len ) == NULL &&
+         this->glob.compile( expr, expr_len, ign_case ) ) {
+      this->is_glob  = true;
+      this->name_len = 0;
+      return true;
+    }
+#ifdef RDB_USE_PCRE
+    uint8_t patbuf[ 1024 ];
+    GlobCvt<uint8_t> gl( patbuf, sizeof( patbuf ) );
     /* make a glob style wildcard into a pcre wildcard */
-    error = gl.convert_glob( (uint8_t *) expr, expr_len, true, ign_case );
+    int error = gl.convert_glob( (uint8_t *) expr, expr_len, true, ign_case );
     if ( error != 0 ) {
       fprintf( stderr, "convert_glob %d\n", error );
       return false;
     }
-    re = pcre2_compile( patbuf, gl.off, 0, &error, &erroff, 0 );
-    if ( re != NULL ) {
-      md = pcre2_match_data_create_from_pattern( re, NULL );
-      if ( md == NULL ) {
-        pcre2_code_free( re );
-        re = NULL;
-      }
-    }
-    if ( re == NULL ) {
-      fprintf( stderr, "pcre(%d,%" PRId64 "): %.*s\n", error, erroff,
-               (int) gl.off, (char *) patbuf );
-      return false;
-    }
-    /* wildcard key filter */
-    this->re = re;
-    this->md = md;
-    this->name_len = 0;
-    return true;
+    return this->compile_re( patbuf, gl.off );
+#else
+    /* the alternatives of a | are each a glob */
+    return this->add_glob_alt( expr, expr_len, ign_case );
+#endif
   }
   /* strcmp key filter */
   ::memcpy( this->name, expr, expr_len );
@@ -67,6 +138,111 @@ PcreFilter::set_filter_expr( const char *expr,  size_t expr_len,
   return true;
 }
 
+bool
+PcreFilter::add_filter_expr( const char *expr,  size_t expr_len,
+                             bool ign_case ) noexcept
+{
+#ifndef RDB_USE_PCRE
+  /* without pcre, each expr is one or more globs */
+  return this->add_glob_alt( expr, expr_len, ign_case );
+#else
+  size_t  need = expr_len * 3 + 64;
+  size_t  k;
+  bool    is_glob = false;
+
+  /* a glob star is 3 chars, a literal char escaped is 2, plus the group */
+  if ( this->alt_len + need > this->alt_size ) {
+    size_t    sz = ( this->alt_len + need ) * 2;
+    uint8_t * p  = (uint8_t *) ::realloc( this->alt, sz );
+    if ( p == NULL ) {
+      ::perror( "realloc" );
+      return false;
+    }
+    this->alt      = p;
+    this->alt_size = sz;
+  }
+  for ( k = 0; k < expr_len; k++ ) {
+    if ( expr[ k ] == '*' || expr[ k ] == '?' || expr[ k ] == '[' ||
+         expr[ k ] == '|' || expr[ k ] == '\\' ) {
+      is_glob = true;
+      break;
+    }
+  }
+  GlobCvt<uint8_t> gl( &this->alt[ this->alt_len ],
+                       this->alt_size - this->alt_len );
+  if ( this->alt_cnt > 0 )
+    gl.char_out( '|' );
+  gl.str_out( "(?:", 3 );
+  if ( is_glob ) {
+    gl.use_commit = false; /* commit would fail the other alternatives */
+    if ( gl.convert_glob( (const uint8_t *) expr, expr_len, true,
+                          ign_case ) != 0 ) {
+      fprintf( stderr, "convert_glob %.*s\n", (int) expr_len, expr );
+      return false;
+    }
+  }
+  else {
+    if ( ign_case )
+      gl.str_out( "(?i)", 4 );
+    gl.str_out( "\\A", 2 );
+    for ( k = 0; k < expr_len; k++ ) {
+      uint8_t c = (uint8_t) expr[ k ];
+      if ( ! ( ( c >= '0' && c <= '9' ) || ( c >= 'a' && c <= 'z' ) ||
+               ( c >= 'A' && c <= 'Z' ) || c >= 0x80 ) )
+        gl.char_out( '\\' );
+      gl.char_out( c );
+    }
+    gl.str_out( "\\z", 2 );
+  }
+  gl.char_out( ')' );
+  this->alt_len += gl.off;
+  this->alt_cnt++;
+  return true;
+#endif
+}
+
+bool
+PcreFilter::add_filter_file( const char *fn,  bool ign_case ) noexcept
+{
+  char   line[ 1024 ];
+  FILE * fp = ::fopen( fn, "r" );
+  bool   ok = true;
+
+  if ( fp == NULL ) {
+    ::perror( fn );
+    return false;
+  }
+  while ( ok && ::fgets( line, sizeof( line ), fp ) != NULL ) {
+    size_t len = ::strlen( line );
+    while ( len > 0 && ( line[ len - 1 ] == '\n' || line[ len - 1 ] == '\r' ) )
+      len--;
+    if ( len > 0 )
+      ok = this->add_filter_expr( line, len, ign_case );
+  }
+  ::fclose( fp );
+  return ok;
+}
+
+bool
+PcreFilter::compile_filter( bool inv ) noexcept
+{
+  bool ok;
+  this->invert = inv;
+  if ( this->alt_cnt == 0 && this->glob_cnt == 0 ) {
+    fprintf( stderr, "no filter expressions\n" );
+    return false;
+  }
+#ifdef RDB_USE_PCRE
+  ok = this->compile_re( this->alt, this->alt_len );
+#else
+  ok = true; /* glob_alt is compiled by add_filter_expr() */
+#endif
+  ::free( this->alt );
+  this->alt = NULL;
+  this->alt_len = this->alt_size = 0;
+  return ok;
+}
+
 bool
 PcreFilter::match_key( const RdbString &key ) noexcept
 {
@@ -82,10 +258,23 @@ PcreFilter::match_key( const RdbString &key ) noexcept
           matched = ( ::strncasecmp( key.s, name, this->name_len ) == 0 );
       }
     }
-    else {
-      matched = ( pcre2_match( this->re, (uint8_t *) key.s, key.s_len, 0, 0,
-                               this->md, 0 ) > 0 );
+    else if ( this->is_glob ) {
+      matched = this->glob.match( key.s, key.s_len );
+    }
+    else if ( this->glob_cnt != 0 ) {
+      for ( size_t i = 0; ! matched && i < this->glob_cnt; i++ )
+        matched = this->glob_alt[ i ]->match( key.s, key.s_len );
     }
+#ifdef RDB_USE_PCRE
+    else if ( this->re != NULL ) {
+      if ( this->is_jit )
+        matched = ( pcre2_jit_match( this->re, (uint8_t *) key.s, key.s_len,
+                                     0, 0, this->md, 0 ) > 0 );
+      else
+        matched = ( pcre2_match( this->re, (uint8_t *) key.s, key.s_len, 0,
+                                 0, this->md, 0 ) > 0 );
+    }
+#endif
   }
   if ( this->invert )
     return ! matched;
@@ -0,0 +1,526 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <rdbparser/rdb_decode.h>
+#include <rdbparser/rdb_json.h>
+#include <rdbparser/rdb_prefix.h>
+
+using namespace rdbparser;
+
+void
+RdbPrefixTable::release( void ) noexcept
+{
+  if ( this->ent != NULL )
+    ::free( this->ent );
+  if ( this->tab != NULL )
+    ::free( this->tab );
+  if ( this->buf != NULL )
+    ::free( this->buf );
+  this->ent      = NULL;
+  this->tab      = NULL;
+  this->buf      = NULL;
+  this->cnt      = 0;
+  this->ent_size = 0;
+  this->mask     = 0;
+  this->buf_len  = 0;
+  this->buf_size = 0;
+}
+
+bool
+RdbPrefixTable::init( char c,  size_t d ) noexcept
+{
+  size_t sz = 1024;
+
+  this->release();
+  this->tab = (uint32_t *) ::calloc( sz, sizeof( uint32_t ) );
+  if ( this->tab == NULL ) {
+    ::perror( "calloc" );
+    return false;
+  }
+  this->mask  = sz - 1;
+  this->delim = c;
+  this->depth = ( d == 0 ? 1 : d );
+  return true;
+}
+
+size_t
+RdbPrefixTable::prefix_len( const RdbString &key ) const noexcept
+{
+  size_t i, len = 0, cnt = 0;
+  if ( key.coding != RDB_STR_VAL )
+    return 0;
+  for ( i = 0; i < key.s_len && cnt < this->depth; i++ ) {
+    if ( key.s[ i ] == this->delim ) {
+      len = i + 1;
+      cnt++;
+    }
+  }
+  return len;
+}
+
+bool
+RdbPrefixTable::grow( void ) noexcept
+{
+  size_t     sz  = ( this->mask + 1 ) * 2, i, j;
+  uint32_t * tab = (uint32_t *) ::calloc( sz, sizeof( uint32_t ) );
+
+  if ( tab == NULL ) {
+    ::perror( "calloc" );
+    return false;
+  }
+  for ( i = 0; i <= this->mask; i++ ) {
+    if ( this->tab[ i ] != 0 ) {
+      for ( j = this->ent[ this->tab[ i ] - 1 ].hash & ( sz - 1 );
+            tab[ j ] != 0; j = ( j + 1 ) & ( sz - 1 ) )
+        ;
+      tab[ j ] = this->tab[ i ];
+    }
+  }
+  ::free( this->tab );
+  this->tab  = tab;
+  this->mask = sz - 1;
+  return true;
+}
+
+bool
+RdbPrefixTable::find( const RdbString &key,  size_t &idx ) noexcept
+{
+  size_t       len = this->prefix_len( key ), i;
+  const char * s   = ( len > 0 ? key.s : "" );
+  uint64_t     h   = xxh64( 0, s, len );
+  uint32_t     j;
+
+  if ( h == 0 )
+    h = 1;
+  for ( i = h & this->mask; (j = this->tab[ i ]) != 0;
+        i = ( i + 1 ) & this->mask ) {
+    const RdbPrefixEntry & e = this->ent[ j - 1 ];
+    if ( e.hash == h && e.len == len &&
+         ::memcmp( &this->buf[ e.off ], s, len ) == 0 ) {
+      idx = j - 1;
+      return true;
+    }
+  }
+  /* new prefix, copy it to buf */
+  if ( this->cnt == this->ent_size ) {
+    size_t sz = ( this->ent_size == 0 ? 1024 : this->ent_size * 2 );
+    RdbPrefixEntry * p =
+      (RdbPrefixEntry *) ::realloc( this->ent, sz * sizeof( p[ 0 ] ) );
+    if ( p == NULL ) {
+      ::perror( "realloc" );
+      return false;
+    }
+    this->ent      = p;
+    this->ent_size = sz;
+  }
+  if ( this->buf_len + len > this->buf_size ) {
+    size_t sz = ( this->buf_size == 0 ? 64 * 1024 : this->buf_size * 2 );
+    while ( sz < this->buf_len + len )
+      sz *= 2;
+    char * p = (char *) ::realloc( this->buf, sz );
+    if ( p == NULL ) {
+      ::perror( "realloc" );
+      return false;
+    }
+    this->buf      = p;
+    this->buf_size = sz;
+  }
+  if ( len > 0 )
+    ::memcpy( &this->buf[ this->buf_len ], s, len );
+  RdbPrefixEntry & e = this->ent[ this->cnt ];
+  e.hash = h;
+  e.off  = this->buf_len;
+  e.len  = len;
+  this->buf_len += len;
+  idx = this->cnt++;
+  this->tab[ i ] = (uint32_t) this->cnt;
+  /* grow at half full */
+  if ( this->cnt * 2 > this->mask )
+    return this->grow();
+  return true;
+}
+
+void
+RdbPrefixTree::release( void ) noexcept
+{
+  if ( this->node != NULL )
+    ::free( this->node );
+  if ( this->tab != NULL )
+    ::free( this->tab );
+  if ( this->seg_buf != NULL )
+    ::free( this->seg_buf );
+  this->node     = NULL;
+  this->tab      = NULL;
+  this->seg_buf  = NULL;
+  this->node_cnt = 0;
+  this->seg_len  = 0;
+  this->seg_size = 0;
+}
+
+bool
+RdbPrefixTree::init( char c,  size_t depth,  size_t n ) noexcept
+{
+  size_t sz = 16;
+
+  this->release();
+  if ( depth == 0 )
+    depth = 1;
+  /* room for a key after a collapse */
+  if ( n < depth * 4 )
+    n = depth * 4;
+  if ( n > 0x7fffffff )
+    n = 0x7fffffff;
+  while ( sz < n * 2 )
+    sz *= 2;
+  this->node = (RdbPrefixNode *) ::calloc( n, sizeof( RdbPrefixNode ) );
+  this->tab  = (uint32_t *) ::calloc( sz, sizeof( uint32_t ) );
+  if ( this->node == NULL || this->tab == NULL ) {
+    ::perror( "calloc" );
+    this->release();
+    return false;
+  }
+  this->delim     = c;
+  this->max_depth = depth;
+  this->max_nodes = n;
+  this->mask      = sz - 1;
+  this->node_cnt  = 1; /* the root */
+  return true;
+}
+
+bool
+RdbPrefixTree::add_seg( const char *seg,  size_t len ) noexcept
+{
+  if ( this->seg_len + len > this->seg_size ) {
+    size_t sz = ( this->seg_size == 0 ? 64 * 1024 : this->seg_size * 2 );
+    while ( sz < this->seg_len + len )
+      sz *= 2;
+    char * p = (char *) ::realloc( this->seg_buf, sz );
+    if ( p == NULL ) {
+      ::perror( "realloc" );
+      return false;
+    }
+    this->seg_buf  = p;
+    this->seg_size = sz;
+  }
+  ::memcpy( &this->seg_buf[ this->seg_len ], seg, len );
+  this->seg_len += len;
+  return true;
+}
+
+uint32_t
+RdbPrefixTree::child( uint32_t parent,  const char *seg,  size_t len ) noexcept
+{
+  uint64_t h = xxh64( parent, seg, len );
+  size_t   i;
+  uint32_t j;
+
+  if ( h == 0 )
+    h = 1;
+  for ( i = h & this->mask; (j = this->tab[ i ]) != 0;
+        i = ( i + 1 ) & this->mask ) {
+    RdbPrefixNode & n = this->node[ j ];
+    if ( n.hash == h && n.parent == parent && n.seg_len == len &&
+         ::memcmp( &this->seg_buf[ n.seg_off ], seg, len ) == 0 )
+      return j;
+  }
+  if ( this->node_cnt >= this->max_nodes || ! this->add_seg( seg, len ) )
+    return 0;
+  j = (uint32_t) this->node_cnt++;
+  RdbPrefixNode & n = this->node[ j ];
+  ::memset( &n, 0, sizeof( n ) );
+  n.hash         = h;
+  n.seg_off      = this->seg_len - len;
+  n.seg_len      = (uint32_t) len;
+  n.parent       = parent;
+  n.next_sibling = this->node[ parent ].first_child;
+  this->node[ parent ].first_child = j;
+  this->tab[ i ] = j;
+  return j;
+}
+
+bool
+RdbPrefixTree::add( const RdbString &key,  uint64_t enc_bytes,
+                    uint64_t elems,  bool has_expire ) noexcept
+{
+  RdbPrefixNode * n = &this->node[ 0 ];
+  uint32_t        p = 0;
+  size_t          i, start = 0, depth = 0;
+
+  if ( this->node_cnt + this->max_depth > this->max_nodes )
+    this->collapse();
+  for (;;) {
+    n->keys      += 1;
+    n->enc_bytes += enc_bytes;
+    n->elems     += elems;
+    n->expires   += ( has_expire ? 1 : 0 );
+    if ( key.coding != RDB_STR_VAL || depth == this->max_depth )
+      return true;
+    /* next segment, the part after the last delimiter is not a prefix */
+    for ( i = start; i < key.s_len; i++ )
+      if ( key.s[ i ] == this->delim )
+        break;
+    if ( i == key.s_len )
+      return true;
+    if ( (p = this->child( p, &key.s[ start ], i + 1 - start )) == 0 )
+      return false;
+    n     = &this->node[ p ];
+    start = i + 1;
+    depth++;
+  }
+}
+
+void
+RdbPrefixTree::rehash( void ) noexcept
+{
+  ::memset( this->tab, 0, ( this->mask + 1 ) * sizeof( uint32_t ) );
+  for ( uint32_t j = 1; j < this->node_cnt; j++ ) {
+    size_t i = this->node[ j ].hash & this->mask;
+    while ( this->tab[ i ] != 0 )
+      i = ( i + 1 ) & this->mask;
+    this->tab[ i ] = j;
+  }
+}
+
+void
+RdbPrefixTree::collapse( void ) noexcept
+{
+  uint64_t   hist[ 64 ], sum = 0, limit;
+  uint32_t * map;
+  size_t     i, j, cnt = this->node_cnt;
+  int        b;
+
+  map = (uint32_t *) ::malloc( cnt * sizeof( uint32_t ) );
+  if ( map == NULL ) {
+    ::perror( "malloc" );
+    return;
+  }
+  /* find the log2 key count which includes half of the nodes, the keys of a
+   * child are never more than the parent, so each subtree is removed whole */
+  ::memset( hist, 0, sizeof( hist ) );
+  for ( i = 1; i < cnt; i++ ) {
+    uint64_t k = this->node[ i ].keys;
+    for ( b = 0; b < 63 && ( k >> ( b + 1 ) ) != 0; b++ )
+      ;
+    hist[ b ]++;
+  }
+  for ( b = 0; b < 63; b++ ) {
+    sum += hist[ b ];
+    if ( sum * 2 >= cnt - 1 )
+      break;
+  }
+  limit = ( b >= 63 ? ~(uint64_t) 0 : ( (uint64_t) 2 << b ) - 1 );
+  /* parents are before children, nodes and segments move down in place */
+  map[ 0 ] = 0;
+  this->seg_len = 0;
+  for ( i = 1, j = 1; i < cnt; i++ ) {
+    RdbPrefixNode & n = this->node[ i ];
+    if ( n.keys <= limit ) {
+      map[ i ] = 0;
+      continue;
+    }
+    n.parent = map[ n.parent ];
+    ::memmove( &this->seg_buf[ this->seg_len ], &this->seg_buf[ n.seg_off ],
+               n.seg_len );
+    n.seg_off      = this->seg_len;
+    this->seg_len += n.seg_len;
+    /* the hash is seeded with the parent index, which may have moved */
+    n.hash = xxh64( n.parent, &this->seg_buf[ n.seg_off ], n.seg_len );
+    if ( n.hash == 0 )
+      n.hash = 1;
+    if ( j != i )
+      this->node[ j ] = n;
+    map[ i ] = (uint32_t) j++;
+  }
+  ::free( map );
+  this->node_cnt = j;
+  /* relink the children, in the order created */
+  for ( i = 0; i < j; i++ )
+    this->node[ i ].first_child = 0;
+  for ( i = j; i > 1; ) {
+    RdbPrefixNode & n = this->node[ --i ];
+    n.next_sibling = this->node[ n.parent ].first_child;
+    this->node[ n.parent ].first_child = (uint32_t) i;
+  }
+  this->rehash();
+  if ( limit > this->collapse_keys )
+    this->collapse_keys = limit;
+  this->collapse_cnt++;
+}
+
+static RdbPrefixNode * sort_node;
+
+static int
+cmp_child( const void *a,  const void *b )
+{
+  uint64_t x = sort_node[ *(const uint32_t *) a ].enc_bytes,
+           y = sort_node[ *(const uint32_t *) b ].enc_bytes;
+  return x > y ? -1 : x < y ? 1 : 0;
+}
+
+static void
+print_line( uint64_t keys,  uint64_t enc_bytes,  uint64_t elems,
+            uint64_t expires,  size_t depth,  const char *path,  size_t len,
+            const char *note ) noexcept
+{
+  RdbString s;
+  s.set( path, len );
+  printf( "%14" PRIu64 " %16" PRIu64 " %14" PRIu64 " %6.1f%% %*s", keys,
+          enc_bytes, elems,
+          keys ? 100.0 * (double) expires / (double) keys : 0,
+          (int) ( depth * 2 ), "" );
+  print_s( s );
+  printf( "%s\n", note );
+}
+
+void
+RdbPrefixTree::print_node( uint32_t i,  size_t depth,  char *path,
+                           size_t path_len ) noexcept
+{
+  RdbPrefixNode & n = this->node[ i ];
+  uint64_t   keys = n.keys, enc_bytes = n.enc_bytes, elems = n.elems,
+             expires = n.expires;
+  uint32_t * child, c;
+  size_t     cnt = 0, k;
+
+  if ( i != 0 ) {
+    ::memcpy( &path[ path_len ], &this->seg_buf[ n.seg_off ], n.seg_len );
+    path_len += n.seg_len;
+  }
+  print_line( keys, enc_bytes, elems, expires, depth, path, path_len,
+              i == 0 ? " (total)" : "" );
+  for ( c = n.first_child; c != 0; c = this->node[ c ].next_sibling )
+    cnt++;
+  if ( cnt == 0 )
+    return;
+  if ( (child = (uint32_t *) ::malloc( cnt * sizeof( uint32_t ) )) == NULL ) {
+    ::perror( "malloc" );
+    return;
+  }
+  for ( k = 0, c = n.first_child; c != 0; c = this->node[ c ].next_sibling )
+    child[ k++ ] = c;
+  sort_node = this->node;
+  ::qsort( child, cnt, sizeof( uint32_t ), cmp_child );
+  for ( k = 0; k < cnt; k++ ) {
+    const RdbPrefixNode & m = this->node[ child[ k ] ];
+    keys      -= m.keys;
+    enc_bytes -= m.enc_bytes;
+    elems     -= m.elems;
+    expires   -= m.expires;
+    this->print_node( child[ k ], depth + 1, path, path_len );
+  }
+  ::free( child );
+  /* keys not in a child: no more prefixes, or in a collapsed subtree */
+  if ( keys != 0 )
+    print_line( keys, enc_bytes, elems, expires, depth + 1, path, path_len,
+                " (rest)" );
+}
+
+void
+RdbPrefixTree::print( void ) noexcept
+{
+  uint64_t * plen, max_len = 0;
+  char     * path;
+  size_t     i;
+
+  if ( this->node == NULL )
+    return;
+  /* the longest path, parents are before children */
+  plen = (uint64_t *) ::malloc( this->node_cnt * sizeof( uint64_t ) );
+  if ( plen == NULL ) {
+    ::perror( "malloc" );
+    return;
+  }
+  plen[ 0 ] = 0;
+  for ( i = 1; i < this->node_cnt; i++ ) {
+    plen[ i ] = plen[ this->node[ i ].parent ] + this->node[ i ].seg_len;
+    if ( plen[ i ] > max_len )
+      max_len = plen[ i ];
+  }
+  ::free( plen );
+  if ( (path = (char *) ::malloc( max_len + 1 )) == NULL ) {
+    ::perror( "malloc" );
+    return;
+  }
+  printf( "%14s %16s %14s %7s prefix\n", "keys", "enc_bytes", "elems",
+          "ttl%" );
+  this->print_node( 0, 0, path, 0 );
+  ::free( path );
+  if ( this->collapse_cnt != 0 )
+    printf( "collapsed %" PRIu64 " times, prefixes with up to %" PRIu64
+            " keys are in the (rest) of the parent, or counted only after"
+            " the collapse\n", this->collapse_cnt, this->collapse_keys );
+}
+
+void
+RdbPrefixOutput::d_start_type( RdbType ) noexcept
+{
+  this->type_off = this->stream_offset();
+}
+
+void
+RdbPrefixOutput::d_start_key( void ) noexcept
+{
+  this->elems = 0;
+}
+
+void
+RdbPrefixOutput::d_string( const RdbString & ) noexcept
+{
+  this->elems = 1;
+}
+
+void
+RdbPrefixOutput::d_module( const RdbString & ) noexcept
+{
+  this->elems++;
+}
+
+void
+RdbPrefixOutput::d_hash( const RdbHashEntry & ) noexcept
+{
+  this->elems++;
+}
+
+void
+RdbPrefixOutput::d_list( const RdbListElem & ) noexcept
+{
+  this->elems++;
+}
+
+void
+RdbPrefixOutput::d_set( const RdbSetMember & ) noexcept
+{
+  this->elems++;
+}
+
+void
+RdbPrefixOutput::d_zset( const RdbZSetMember & ) noexcept
+{
+  this->elems++;
+}
+
+void
+RdbPrefixOutput::d_stream_entry( const RdbStreamEntry & ) noexcept
+{
+  this->elems++;
+}
+
+void
+RdbPrefixOutput::d_end_key( void ) noexcept
+{
+  if ( this->failed )
+    return;
+  if ( ! this->tree.add( this->dec.key, this->stream_offset() - this->type_off,
+                         this->elems, this->dec.expire_ms != 0 ) )
+    this->failed = true;
+}
+
+void
+RdbPrefixOutput::d_finish( bool success ) noexcept
+{
+  if ( success && ! this->failed )
+    this->tree.print();
+}
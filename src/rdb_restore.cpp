@@ -1,18 +1,147 @@
+#if defined( __linux__ ) && ! defined( _GNU_SOURCE )
+#define _GNU_SOURCE /* for vmsplice() */
+#endif
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
+#if defined( __linux__ )
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#endif
+#ifndef _MSC_VER
+#include <time.h>
+#include <sys/time.h>
+#else
+#include <windows.h>
+#endif
 #include <rdbparser/rdb_decode.h>
+#include <rdbparser/rdb_encode.h>
 #include <rdbparser/rdb_restore.h>
+#include <rdbparser/rdb_diff.h>
 
 using namespace rdbparser;
 
 void RestoreOutput::d_expired_ms( uint64_t ms ) noexcept { this->ttl_ms = ms; }
-void RestoreOutput::d_idle( uint64_t i ) noexcept        { this->idle = i; }
-void RestoreOutput::d_freq( uint8_t f ) noexcept         { this->freq = f; }
-void RestoreOutput::d_start_key( void ) noexcept    { this->is_matched = true; }
+void RestoreOutput::d_expired( uint32_t sec ) noexcept {
+  this->ttl_ms = (uint64_t) sec * 1000;
+}
+void RestoreOutput::d_dbselect( uint32_t n ) noexcept { this->db = n; }
+
+void
+RestoreOutput::d_start_key( void ) noexcept
+{
+  const RdbString & key = this->dec.key;
+  char   tmp[ 32 ];
+  const char * s = tmp;
+  size_t len;
+  /* copy the key, it may be in lzf memory released before
+   * write_restore_cmd(), an int key is sent as its decimal string */
+  if ( key.coding == RDB_STR_VAL ) {
+    s   = key.s;
+    len = key.s_len;
+  }
+  else {
+    len = (size_t) snprintf( tmp, sizeof( tmp ), "%" PRId64, key.ival );
+  }
+  if ( len + 1 > this->key_size ) {
+    char * p = (char *) ::realloc( this->key_buf, len + 1 );
+    if ( p == NULL ) {
+      ::perror( "realloc" );
+      return;
+    }
+    this->key_buf  = p;
+    this->key_size = len + 1;
+  }
+  ::memcpy( this->key_buf, s, len );
+  this->key.set( this->key_buf, len );
+  this->is_matched = true;
+  if ( this->tc.ver != 0 )
+    this->tc.start( this->dec.type );
+}
+
+/* elements are only collected when the type is transcoded */
+void
+RestoreOutput::d_hash( const RdbHashEntry &h ) noexcept
+{
+  this->tc.push( h.field );
+  this->tc.push( h.val );
+}
+
+void
+RestoreOutput::d_list( const RdbListElem &l ) noexcept
+{
+  this->tc.push( l.val );
+}
+
+void
+RestoreOutput::d_zset( const RdbZSetMember &z ) noexcept
+{
+  this->tc.push( z.member );
+  this->tc.push( z.score );
+}
+
+/* encode while the decompressed data is still valid */
+void
+RestoreOutput::d_end_key( void ) noexcept
+{
+  if ( this->tc.ver != 0 )
+    this->tc_status = this->tc.encode();
+}
+
+bool
+RestoreOutput::set_target_version( uint16_t ver ) noexcept
+{
+  if ( ver != 0 && ver < 9 )
+    return false;
+  this->tc.ver = ver;
+  return true;
+}
+
+void
+RestoreOutput::d_idle( uint64_t i ) noexcept
+{
+  this->idle     = i;
+  this->has_idle = true;
+}
+
+void
+RestoreOutput::d_freq( uint8_t f ) noexcept
+{
+  this->freq     = f;
+  this->has_freq = true;
+}
+
+uint64_t
+RestoreOutput::current_time_ms( void ) noexcept
+{
+#ifndef _MSC_VER
+  struct timeval tv;
+  ::gettimeofday( &tv, NULL );
+  return (uint64_t) tv.tv_sec * 1000 + (uint64_t) tv.tv_usec / 1000;
+#else
+  FILETIME ft; /* 100ns intervals since 1601 */
+  GetSystemTimeAsFileTime( &ft );
+  uint64_t t = ( (uint64_t) ft.dwHighDateTime << 32 ) | ft.dwLowDateTime;
+  return t / 10000 - (uint64_t) 11644473600000ULL;
+#endif
+}
+
+void
+RestoreOutput::put_uint_arg( uint64_t val ) noexcept
+{
+  char buf[ 32 ], tmp[ 16 ];
+  int  n = snprintf( buf, sizeof( buf ), "%" PRIu64, val ),
+       m = snprintf( tmp, sizeof( tmp ), "$%d\r\n", n );
+  this->put( tmp, m );
+  buf[ n ] = '\r'; buf[ n + 1 ] = '\n';
+  this->put( buf, n + 2 );
+}
 
 void
 RestoreOutput::d_start_type( RdbType ) noexcept
@@ -21,6 +150,200 @@ RestoreOutput::d_start_type( RdbType ) noexcept
   this->type_offset = this->bptr.offset;
 }
 
+void
+RestoreOutput::start_cmd( const RdbString &key,  uint64_t db,
+                          size_t len ) noexcept
+{
+  if ( this->sink != NULL )
+    this->sink->start_cmd( key, db, len );
+  else if ( db != this->out_db ) {
+    char sel[ 64 ];
+    this->put( sel, RestoreSink::select_cmd( sel, sizeof( sel ), db ) );
+    this->out_db = db;
+  }
+}
+
+size_t
+RestoreSink::select_cmd( char *buf,  size_t len,  uint64_t db ) noexcept
+{
+  char num[ 32 ];
+  int  n = snprintf( num, sizeof( num ), "%" PRIu64, db );
+  return (size_t) snprintf( buf, len, "*2\r\n$6\r\nSELECT\r\n$%d\r\n%s\r\n",
+                            n, num );
+}
+
+void
+RestoreOutput::write_del( const RdbString &key,  uint64_t db ) noexcept
+{
+  char tmp[ 32 ];
+  int  n;
+  if ( this->pace.is_enabled() )
+    this->wait_pace( key.s_len + 32 );
+  this->start_cmd( key, db, key.s_len + 32 );
+  static const char del[] = "*2\r\n$3\r\nDEL\r\n";
+  this->put( del, sizeof( del ) - 1 );
+  n = snprintf( tmp, sizeof( tmp ), "$%" PRIu64 "\r\n", (uint64_t) key.s_len );
+  this->put( tmp, n );
+  this->put( key.s, key.s_len );
+  this->put( "\r\n", 2 );
+  if ( this->sink != NULL )
+    this->sink->end_cmd( key );
+  this->del_cnt++;
+}
+
+uint64_t
+RestorePacer::mono_us( void ) noexcept
+{
+#ifndef _MSC_VER
+  struct timespec ts;
+  ::clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
+#else
+  LARGE_INTEGER cnt, freq;
+  QueryPerformanceCounter( &cnt );
+  QueryPerformanceFrequency( &freq );
+  return (uint64_t) ( (double) cnt.QuadPart * 1000000.0 /
+                      (double) freq.QuadPart );
+#endif
+}
+
+void
+RestorePacer::set_rate( double bytes_sec,  double cmds_sec ) noexcept
+{
+  this->bytes_per_sec = bytes_sec;
+  this->cmds_per_sec  = cmds_sec;
+  /* allow a burst of 1/10 second */
+  this->byte_burst    = bytes_sec / 10.0;
+  this->cmd_burst     = cmds_sec / 10.0;
+  if ( this->byte_burst < 64.0 * 1024.0 )
+    this->byte_burst = 64.0 * 1024.0;
+  if ( this->cmd_burst < 1.0 )
+    this->cmd_burst = 1.0;
+  this->byte_tokens   = this->byte_burst;
+  this->cmd_tokens    = this->cmd_burst;
+  this->last_us       = mono_us();
+}
+
+/* refill buckets, a command can go when the buckets have enough tokens or
+ * are full, a large command takes the buckets into debt, which delays the
+ * commands after it rather than sending it in pieces */
+uint64_t
+RestorePacer::wait_us( size_t len ) noexcept
+{
+  uint64_t now  = mono_us();
+  double   secs = (double) ( now - this->last_us ) / 1000000.0,
+           wait = 0;
+  this->last_us = now;
+  if ( this->bytes_per_sec > 0 ) {
+    double need = ( (double) len < this->byte_burst ? (double) len
+                                                     : this->byte_burst );
+    this->byte_tokens += secs * this->bytes_per_sec;
+    if ( this->byte_tokens > this->byte_burst )
+      this->byte_tokens = this->byte_burst;
+    if ( this->byte_tokens < need )
+      wait = ( need - this->byte_tokens ) / this->bytes_per_sec;
+  }
+  if ( this->cmds_per_sec > 0 ) {
+    this->cmd_tokens += secs * this->cmds_per_sec;
+    if ( this->cmd_tokens > this->cmd_burst )
+      this->cmd_tokens = this->cmd_burst;
+    if ( this->cmd_tokens < 1.0 ) {
+      double w = ( 1.0 - this->cmd_tokens ) / this->cmds_per_sec;
+      if ( w > wait )
+        wait = w;
+    }
+  }
+  if ( wait <= 0 )
+    return 0;
+  return (uint64_t) ( wait * 1000000.0 ) + 1;
+}
+
+void
+RestorePacer::consume( size_t len ) noexcept
+{
+  this->byte_tokens -= (double) len;
+  this->cmd_tokens  -= 1.0;
+}
+
+void
+RestoreSink::wait( uint64_t us ) noexcept
+{
+  sleep_us( us );
+}
+
+void
+rdbparser::sleep_us( uint64_t us ) noexcept
+{
+#ifndef _MSC_VER
+  struct timespec ts;
+  ts.tv_sec  = (time_t) ( us / 1000000 );
+  ts.tv_nsec = (long) ( us % 1000000 ) * 1000;
+  ::nanosleep( &ts, NULL );
+#else
+  Sleep( (DWORD) ( ( us + 999 ) / 1000 ) );
+#endif
+}
+
+void
+RestoreOutput::wait_pace( size_t len ) noexcept
+{
+  uint64_t us;
+  fflush( stdout );
+  while ( (us = this->pace.wait_us( len )) != 0 ) {
+    if ( this->sink != NULL )
+      this->sink->wait( us );
+    else
+      sleep_us( us );
+  }
+  this->pace.consume( len );
+}
+
+bool
+RestoreOutput::init_splice( int fd ) noexcept
+{
+#if defined( __linux__ )
+  struct stat st;
+  if ( ::fstat( fd, &st ) == 0 && S_ISFIFO( st.st_mode ) ) {
+    this->splice_fd = fd;
+    return true;
+  }
+#else
+  (void) fd;
+#endif
+  this->splice_fd = -1;
+  return false;
+}
+
+void
+RestoreOutput::write_body( const uint8_t *b,  size_t len ) noexcept
+{
+#if defined( __linux__ )
+  /* the body is in page cache, map it into the pipe, the resp header and
+   * trailer are small and are copied through stdio */
+  if ( this->splice_fd >= 0 && len >= this->splice_min ) {
+    fflush( stdout );
+    while ( len > 0 ) {
+      struct iovec iov;
+      iov.iov_base = (void *) b;
+      iov.iov_len  = len;
+      ssize_t n = ::vmsplice( this->splice_fd, &iov, 1, 0 );
+      if ( n < 0 ) {
+        if ( errno == EINTR )
+          continue;
+        ::perror( "vmsplice" );
+        this->splice_fd = -1; /* fall back to copying the rest */
+        break;
+      }
+      b    = &b[ n ];
+      len -= (size_t) n;
+    }
+    if ( len == 0 )
+      return;
+  }
+#endif
+  fwrite( b, 1, len, stdout );
+}
+
 void
 RestoreOutput::write_restore_cmd( void ) noexcept
 {
@@ -38,63 +361,135 @@ RestoreOutput::write_restore_cmd( void ) noexcept
     fprintf( stderr, "Buffer does not contain key!!\n" );
     return;
   }
-  RdbString     & key = this->dec.key;
+  const RdbString & key = this->key;
   const uint8_t * buf = &this->bptr.buf[ -(int64_t) this->bptr.offset ];
   RdbLength       len;
   char            tmp[ 16 ]; /* snprintf() */
   int             n;
   uint64_t        crc;
-  
-  if ( this->dec.is_rdb_file ) /* skip over type and key */
-    start += 1 + len.decode_buf( &buf[ start + 1 ] ) + key.s_len;
+
+  /* same hash as RdbHashOutput, the record with the expire */
+  if ( this->delta != NULL &&
+       ! this->delta->check( this->db, key, this->dec.type, end - start,
+                             xxh64( this->ttl_ms, &buf[ start ],
+                                    end - start ) ) ) {
+    this->same_cnt++;
+    this->reset_state();
+    return;
+  }
+  if ( this->dec.is_rdb_file ) { /* skip over type and key */
+    start += 1 + len.decode_buf( &buf[ start + 1 ] );
+    if ( len.is_lzf )
+      start += len.zlen;
+    else if ( ! len.is_enc )
+      start += len.len;
+  }
   else
     start += 1; /* no key in dump */
 
-  /* command to write: RESTORE key ttl <type><data><ver><crc> */
-  /* write the restore */
-  static const char use_repl[] = "*5";
-  static const char restore[]  = "*4\r\n$7\r\nRESTORE\r\n";
-  if ( this->use_replace ) {
-    fwrite( use_repl, 1, 2, stdout );
-    fwrite( &restore[ 2 ], 1, sizeof( restore ) - 3, stdout );
+  if ( this->tc_status == RdbTranscode::TC_NOTSUP ) {
+    fprintf( stderr, "Key \"%.*s\" type %d not loadable by rdb version %u\n",
+             (int) key.s_len, key.s, (int) this->dec.type, this->tc.ver );
+    this->notsup_cnt++;
+    this->reset_state();
+    return;
   }
-  else {
-    fwrite( restore, 1, sizeof( restore ) - 1, stdout );
+  /* keys already expired would be dropped by the target, a changed key is
+   * deleted, the delta has it as restored and the old value is stale */
+  if ( this->ttl_ms != 0 && this->ttl_ms <= current_time_ms() ) {
+    if ( this->delta != NULL )
+      this->write_del( key, this->db );
+    this->expired_cnt++;
+    this->reset_state();
+    return;
+  }
+  /* the body and type are either the source bytes or transcoded */
+  const uint8_t * body     = &buf[ start ],
+                * type_ptr = &buf[ this->type_offset ];
+  size_t          body_len = end - start;
+  uint8_t         type_byte;
+  if ( this->tc_status == RdbTranscode::TC_ENCODED ) {
+    type_byte = (uint8_t) this->tc.type;
+    type_ptr  = &type_byte;
+    body      = this->tc.buf;
+    body_len  = this->tc.buf_len;
   }
+  /* command to write:
+   * RESTORE key ttl <type><data><ver><crc> [REPLACE] [ABSTTL]
+   *   [IDLETIME sec | FREQ f] */
+  size_t argc = 4;
+  if ( this->use_replace )
+    argc++;
+  if ( this->ttl_ms != 0 )
+    argc++;
+  if ( this->has_idle || this->has_freq )
+    argc += 2;
+  /* approximate size, the args other than key and body are small */
+  size_t cmd_len = key.s_len + body_len + 128;
+  if ( this->pace.is_enabled() )
+    this->wait_pace( cmd_len );
+  /* write the restore */
+  this->start_cmd( key, this->db, cmd_len );
+  n = snprintf( tmp, sizeof( tmp ), "*%u\r\n", (uint32_t) argc );
+  this->put( tmp, n );
+  static const char restore[] = "$7\r\nRESTORE\r\n";
+  this->put( restore, sizeof( restore ) - 1 );
   /* write the key */
   n = snprintf( tmp, sizeof( tmp ), "$%" PRId64 "\r\n", key.s_len );
-  fwrite( tmp, 1, n, stdout );
-  fwrite( key.s, 1, key.s_len, stdout );
+  this->put( tmp, n );
+  this->put( key.s, key.s_len );
+  this->put( "\r\n", 2 );
+
+  /* write the ttl, absolute unix ms when ABSTTL is used, or 0 */
+  this->put_uint_arg( this->ttl_ms );
 
-  /* write the ttl (0) (plus linefeed for key) */
-  static const char ttl_0[] = "\r\n$1\r\n0\r\n";
-  fwrite( ttl_0, 1, sizeof( ttl_0 ) - 1, stdout );
-  
   /* write the data length: <type><data><ver><crc> */
-  n = snprintf( tmp, sizeof( tmp ), "$%" PRId64 "\r\n", end - start + 1 + 10 );
-  fwrite( tmp, 1, n, stdout ); /* $len\r\n */
+  n = snprintf( tmp, sizeof( tmp ), "$%" PRId64 "\r\n", body_len + 1 + 10 );
+  this->put( tmp, n ); /* $len\r\n */
 
   /* write the type byte */
-  fwrite( &buf[ this->type_offset ], 1, 1, stdout );
-  crc = jones_crc64( 0, &buf[ this->type_offset ], 1 );
+  this->put( type_ptr, 1 );
+  crc = jones_crc64( 0, type_ptr, 1 );
 
-  /* write the data body */
-  fwrite( &buf[ start ], 1, end - start, stdout );
-  crc = jones_crc64( crc, &buf[ start ], end - start );
+  /* write the data body, only the mapped input can be spliced */
+  if ( this->tc_status == RdbTranscode::TC_ENCODED || this->sink != NULL )
+    this->put( body, body_len );
+  else
+    this->write_body( body, body_len );
+  crc = jones_crc64( crc, body, body_len );
 
-  /* write the version 9 */
-  static uint8_t ver[ 2 ] = { 0x09, 0x00 };
-  fwrite( ver, 1, 2, stdout );
+  /* write the version, 9 unless a target is set */
+  uint8_t ver[ 2 ];
+  le<uint16_t>( ver, this->tc.ver != 0 ? this->tc.ver : 9 );
+  this->put( ver, 2 );
   crc = jones_crc64( crc, ver, 2 );
 
   /* write the crc */
-  fwrite( &crc, 1, 8, stdout );
-  fwrite( "\r\n", 1, 2, stdout );
+  this->put( &crc, 8 );
+  this->put( "\r\n", 2 );
   if ( this->use_replace ) {
     static const char repl[] = "$7\r\nREPLACE\r\n";
-    fwrite( repl, 1, sizeof( repl ) - 1, stdout );
+    this->put( repl, sizeof( repl ) - 1 );
   }
-  fflush( stdout );
+  if ( this->ttl_ms != 0 ) {
+    static const char absttl[] = "$6\r\nABSTTL\r\n";
+    this->put( absttl, sizeof( absttl ) - 1 );
+  }
+  /* the rdb has either idle or freq, depending on the maxmemory-policy */
+  if ( this->has_idle ) {
+    static const char idletime[] = "$8\r\nIDLETIME\r\n";
+    this->put( idletime, sizeof( idletime ) - 1 );
+    this->put_uint_arg( this->idle );
+  }
+  else if ( this->has_freq ) {
+    static const char freq[] = "$4\r\nFREQ\r\n";
+    this->put( freq, sizeof( freq ) - 1 );
+    this->put_uint_arg( this->freq );
+  }
+  if ( this->sink != NULL )
+    this->sink->end_cmd( key );
+  else
+    fflush( stdout );
 
   this->reset_state();
 }
@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <rdbparser/rdb_decode.h>
+#include <rdbparser/rdb_slot.h>
+
+using namespace rdbparser;
+
+static uint16_t crc16_tab[ 256 ];
+
+static void
+crc16_init( void )
+{
+  static const uint16_t POLY = 0x1021;
+  for ( uint32_t n = 0; n < 256; n++ ) {
+    uint16_t crc = (uint16_t) ( n << 8 );
+    for ( int k = 0; k < 8; k++ )
+      crc = (uint16_t) ( ( crc & 0x8000 ) != 0 ? ( crc << 1 ) ^ POLY
+                                               : ( crc << 1 ) );
+    crc16_tab[ n ] = crc;
+  }
+}
+
+uint16_t
+rdbparser::crc16_xmodem( uint16_t crc,  const void *buf,  size_t len ) noexcept
+{
+  if ( crc16_tab[ 1 ] == 0 )
+    crc16_init();
+  const uint8_t * p = (const uint8_t *) buf;
+  for ( size_t i = 0; i < len; i++ )
+    crc = (uint16_t) ( ( crc << 8 ) ^ crc16_tab[ ( ( crc >> 8 ) ^ p[ i ] ) &
+                                                 0xff ] );
+  return crc;
+}
+
+uint16_t
+rdbparser::key_hash_slot( const void *key,  size_t len ) noexcept
+{
+  const uint8_t * k = (const uint8_t *) key,
+                * s = (const uint8_t *) ::memchr( k, '{', len );
+  if ( s != NULL ) {
+    size_t off = (size_t) ( s - k ) + 1;
+    const uint8_t * e = (const uint8_t *) ::memchr( &k[ off ], '}',
+                                                     len - off );
+    /* hash the tag if not empty: {tag} */
+    if ( e != NULL && e != &k[ off ] ) {
+      k   = &k[ off ];
+      len = (size_t) ( e - k );
+    }
+  }
+  return crc16_xmodem( 0, k, len ) & ( RDB_CLUSTER_SLOTS - 1 );
+}
+
+uint16_t
+rdbparser::key_hash_slot( const RdbString &key ) noexcept
+{
+  char tmp[ 32 ];
+  if ( key.coding == RDB_STR_VAL )
+    return key_hash_slot( key.s, key.s_len );
+  int n = snprintf( tmp, sizeof( tmp ), "%" PRId64, key.ival );
+  return key_hash_slot( tmp, (size_t) n );
+}
+
+void
+RdbSlotMap::release( void ) noexcept
+{
+  for ( size_t i = 0; i < this->out_cnt; i++ )
+    ::free( this->name[ i ] );
+  if ( this->name != NULL )
+    ::free( this->name );
+  this->name    = NULL;
+  this->out_cnt = 0;
+}
+
+bool
+RdbSlotMap::add_name( const char *nm,  size_t len,  uint16_t &i ) noexcept
+{
+  for ( i = 0; i < this->out_cnt; i++ ) {
+    if ( ::strlen( this->name[ i ] ) == len &&
+         ::memcmp( this->name[ i ], nm, len ) == 0 )
+      return true;
+  }
+  char ** p = (char **) ::realloc( this->name,
+                                   sizeof( char * ) * ( this->out_cnt + 1 ) );
+  if ( p == NULL )
+    return false;
+  this->name = p;
+  if ( (p[ i ] = (char *) ::malloc( len + 1 )) == NULL )
+    return false;
+  ::memcpy( p[ i ], nm, len );
+  p[ i ][ len ] = '\0';
+  this->out_cnt++;
+  return true;
+}
+
+bool
+RdbSlotMap::split( size_t n ) noexcept
+{
+  char     nm[ 32 ];
+  uint16_t i;
+  this->release();
+  if ( n == 0 || n > RDB_CLUSTER_SLOTS ) {
+    fprintf( stderr, "split %" PRIu64 " not in range 1 -> %u\n",
+             (uint64_t) n, RDB_CLUSTER_SLOTS );
+    return false;
+  }
+  for ( size_t j = 0; j < n; j++ ) {
+    size_t start = j * RDB_CLUSTER_SLOTS / n,
+           end   = ( j + 1 ) * RDB_CLUSTER_SLOTS / n;
+    int    len   = snprintf( nm, sizeof( nm ), "%u-%u", (uint32_t) start,
+                             (uint32_t) ( end - 1 ) );
+    if ( ! this->add_name( nm, len, i ) )
+      return false;
+    for ( size_t slot = start; slot < end; slot++ )
+      this->idx[ slot ] = i;
+  }
+  return true;
+}
+
+bool
+RdbSlotMap::load( const char *fn ) noexcept
+{
+  static const uint16_t NO_OUTPUT = 0xffff;
+  char   line[ 1024 ];
+  size_t lineno = 0, missing = 0;
+  FILE * fp = ::fopen( fn, "r" );
+
+  if ( fp == NULL ) {
+    ::perror( fn );
+    return false;
+  }
+  this->release();
+  for ( size_t slot = 0; slot < RDB_CLUSTER_SLOTS; slot++ )
+    this->idx[ slot ] = NO_OUTPUT;
+  while ( ::fgets( line, sizeof( line ), fp ) != NULL ) {
+    char   * p = line, * e;
+    uint16_t i;
+    lineno++;
+    if ( (e = ::strchr( p, '#' )) != NULL )
+      *e = '\0';
+    while ( isspace( (uint8_t) *p ) )
+      p++;
+    if ( *p == '\0' )
+      continue;
+    /* start[-end] name */
+    unsigned long start = ::strtoul( p, &e, 10 ), end = start;
+    if ( e != p && *e == '-' ) {
+      p   = &e[ 1 ];
+      end = ::strtoul( p, &e, 10 );
+    }
+    if ( e == p || ! isspace( (uint8_t) *e ) || start > end ||
+         end >= RDB_CLUSTER_SLOTS )
+      goto bad_line;
+    for ( p = e; isspace( (uint8_t) *p ); p++ )
+      ;
+    for ( e = p; *e != '\0' && ! isspace( (uint8_t) *e ); e++ )
+      ;
+    if ( e == p )
+      goto bad_line;
+    if ( ! this->add_name( p, (size_t) ( e - p ), i ) ) {
+      ::perror( "malloc" );
+      ::fclose( fp );
+      return false;
+    }
+    for ( ; start <= end; start++ )
+      this->idx[ start ] = i;
+    continue;
+  bad_line:;
+    fprintf( stderr, "%s:%" PRIu64 ": expected \"start[-end] name\"\n", fn,
+             (uint64_t) lineno );
+    ::fclose( fp );
+    return false;
+  }
+  ::fclose( fp );
+  for ( size_t slot = 0; slot < RDB_CLUSTER_SLOTS; slot++ ) {
+    if ( this->idx[ slot ] == NO_OUTPUT ) {
+      if ( missing++ == 0 )
+        fprintf( stderr, "%s: slot %u not mapped\n", fn, (uint32_t) slot );
+    }
+  }
+  if ( missing != 0 ) {
+    fprintf( stderr, "%s: %" PRIu64 " slots not mapped\n", fn,
+             (uint64_t) missing );
+    return false;
+  }
+  return true;
+}
+
+bool
+RestoreSlotSplit::open( const char *prefix ) noexcept
+{
+  size_t n = this->map.out_cnt;
+  this->fp      = (FILE **) ::calloc( n, sizeof( FILE * ) );
+  this->key_cnt = (uint64_t *) ::calloc( n, sizeof( uint64_t ) );
+  this->db      = (uint64_t *) ::calloc( n, sizeof( uint64_t ) );
+  if ( this->fp == NULL || this->key_cnt == NULL || this->db == NULL ) {
+    ::perror( "calloc" );
+    return false;
+  }
+  for ( size_t i = 0; i < n; i++ ) {
+    char fn[ 1024 ];
+    snprintf( fn, sizeof( fn ), "%s.%s.resp", prefix, this->map.name[ i ] );
+    if ( (this->fp[ i ] = ::fopen( fn, "wb" )) == NULL ) {
+      ::perror( fn );
+      return false;
+    }
+  }
+  return true;
+}
+
+bool
+RestoreSlotSplit::close( void ) noexcept
+{
+  bool ok = true;
+  if ( this->fp != NULL ) {
+    for ( size_t i = 0; i < this->map.out_cnt; i++ ) {
+      if ( this->fp[ i ] != NULL && ::fclose( this->fp[ i ] ) != 0 ) {
+        ::perror( this->map.name[ i ] );
+        ok = false;
+      }
+    }
+    ::free( this->fp );
+  }
+  if ( this->key_cnt != NULL )
+    ::free( this->key_cnt );
+  if ( this->db != NULL )
+    ::free( this->db );
+  this->fp      = NULL;
+  this->key_cnt = NULL;
+  this->db      = NULL;
+  this->cur     = NULL;
+  return ok;
+}
+
+void
+RestoreSlotSplit::start_cmd( const RdbString &key,  uint64_t db,
+                             size_t ) noexcept
+{
+  uint16_t i = this->map.key_output( key );
+  this->cur = this->fp[ i ];
+  this->key_cnt[ i ]++;
+  if ( this->db[ i ] != db ) {
+    char sel[ 64 ];
+    fwrite( sel, 1, RestoreSink::select_cmd( sel, sizeof( sel ), db ),
+            this->cur );
+    this->db[ i ] = db;
+  }
+}
+
+void
+RestoreSlotSplit::write( const void *p,  size_t len ) noexcept
+{
+  fwrite( p, 1, len, this->cur );
+}
+
+void
+RestoreSlotSplit::end_cmd( const RdbString & ) noexcept
+{
+  this->cur = NULL;
+}
@@ -0,0 +1,411 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <rdbparser/rdb_decode.h>
+#include <rdbparser/rdb_restore.h>
+#include <rdbparser/rdb_where.h>
+#include <rdbparser/rdb_json.h>
+#include <rdbparser/rdb_stats.h>
+
+using namespace rdbparser;
+
+static const char *stats_type_name[ RdbStatsOutput::TYPE_CLASSES ] = {
+  "string", "list", "set", "zset", "hash", "stream", "module", "unknown"
+};
+
+bool
+RdbSampleFilter::set_rate( double rate ) noexcept
+{
+  if ( ! ( rate > 0.0 && rate <= 1.0 ) ) {
+    fprintf( stderr, "sample rate %g should be > 0 and <= 1\n", rate );
+    return false;
+  }
+  if ( rate >= 1.0 )
+    this->threshold = ~(uint64_t) 0;
+  else
+    this->threshold = (uint64_t) ( rate * 18446744073709551616.0 );
+  return true;
+}
+
+bool
+RdbSampleFilter::match_key( const RdbString &key ) noexcept
+{
+  this->in_pop = ( this->next == NULL || this->next->match_key( key ) );
+  if ( ! this->in_pop )
+    return false;
+  if ( this->every != 0 )
+    return ( this->key_cnt++ % this->every ) == 0;
+  this->key_cnt++;
+  if ( key.coding == RDB_STR_VAL )
+    return xxh64( 0, key.s, key.s_len ) <= this->threshold;
+  char tmp[ 32 ];
+  int  n = snprintf( tmp, sizeof( tmp ), "%" PRId64, key.ival );
+  return xxh64( 0, tmp, (size_t) n ) <= this->threshold;
+}
+
+void
+RdbEstimate::compute( double sum,  double sum_sq,  uint64_t n,
+                      uint64_t N ) noexcept
+{
+  this->total = this->err = 0;
+  if ( n == 0 )
+    return;
+  double mean = sum / (double) n;
+  this->total = mean * (double) N;
+  if ( n > 1 && n < N ) {
+    double var = ( sum_sq - (double) n * mean * mean ) / (double) ( n - 1 ),
+           fpc = 1.0 - (double) n / (double) N;
+    if ( var > 0 )
+      this->err = 1.96 * (double) N * sqrt( var / (double) n * fpc );
+  }
+}
+
+bool
+RdbTopK::init( size_t n,  bool min ) noexcept
+{
+  this->heap = (RdbTopEntry *) ::malloc( n * sizeof( RdbTopEntry ) );
+  if ( this->heap == NULL ) {
+    ::perror( "malloc" );
+    return false;
+  }
+  this->k      = n;
+  this->cnt    = 0;
+  this->is_min = min;
+  return true;
+}
+
+void
+RdbTopK::sift_down( size_t i ) noexcept
+{
+  RdbTopEntry * h = this->heap;
+  for (;;) {
+    size_t l = i * 2 + 1, r = l + 1, m = i;
+    if ( l < this->cnt && h[ l ].val < h[ m ].val )
+      m = l;
+    if ( r < this->cnt && h[ r ].val < h[ m ].val )
+      m = r;
+    if ( m == i )
+      break;
+    RdbTopEntry tmp;
+    ::memcpy( &tmp, &h[ i ], sizeof( tmp ) );
+    ::memcpy( &h[ i ], &h[ m ], sizeof( tmp ) );
+    ::memcpy( &h[ m ], &tmp, sizeof( tmp ) );
+    i = m;
+  }
+}
+
+void
+RdbTopK::push( uint64_t val,  uint64_t db,  const RdbString &key ) noexcept
+{
+  RdbTopEntry * e;
+  size_t        i;
+
+  if ( this->cnt < this->k ) {
+    /* sift up from the end */
+    for ( i = this->cnt++; i > 0; ) {
+      size_t p = ( i - 1 ) / 2;
+      if ( this->heap[ p ].val <= val )
+        break;
+      ::memcpy( &this->heap[ i ], &this->heap[ p ], sizeof( RdbTopEntry ) );
+      i = p;
+    }
+    e = &this->heap[ i ];
+  }
+  else {
+    /* replace the smallest */
+    e = &this->heap[ 0 ];
+    i = 0;
+  }
+  e->val = val;
+  e->db  = db;
+  if ( key.coding == RDB_STR_VAL ) {
+    e->key_len = key.s_len;
+    ::memcpy( e->key, key.s, key.s_len < RdbTopEntry::KEY_MAX ? key.s_len :
+              RdbTopEntry::KEY_MAX );
+  }
+  else {
+    e->key_len = (size_t) snprintf( e->key, sizeof( e->key ), "%" PRId64,
+                                    key.ival );
+  }
+  if ( e == &this->heap[ 0 ] && this->cnt == this->k )
+    this->sift_down( 0 );
+}
+
+static int
+cmp_top( const void *a,  const void *b )
+{
+  uint64_t x = ( (const RdbTopEntry *) a )->val,
+           y = ( (const RdbTopEntry *) b )->val;
+  return x > y ? -1 : x < y ? 1 : 0;
+}
+
+void
+RdbTopK::sort( void ) noexcept
+{
+  if ( this->cnt > 1 )
+    ::qsort( this->heap, this->cnt, sizeof( RdbTopEntry ), cmp_top );
+}
+
+RdbStatsOutput::RdbStatsOutput( RdbDecode &dec,  RdbBufptr &b ) noexcept
+  : RdbOutput( dec ), bptr( b ), sample( 0 ), top_k( 0 ), type_off( 0 ),
+    elems( 0 ),
+    bytes( 0 ), key_cnt( 0 ), expired_cnt( 0 ), cls( 0 ),
+    is_decoded( false )
+{
+  ::memset( this->type, 0, sizeof( this->type ) );
+  ::memset( this->size_hist, 0, sizeof( this->size_hist ) );
+  this->now_ms = RestoreOutput::current_time_ms();
+}
+
+uint64_t
+RdbStatsOutput::str_size( const RdbString &s ) noexcept
+{
+  switch ( s.coding ) {
+    case RDB_STR_VAL: return s.s_len;
+    case RDB_INT_VAL:
+    case RDB_DBL_VAL: return 8;
+    default:          return 0;
+  }
+}
+
+void
+RdbStatsOutput::d_start_type( RdbType t ) noexcept
+{
+  int c = RdbWhereFilter::rdb_type_class( t );
+  this->cls        = ( c < 0 ? TYPE_CLASSES - 1 : c );
+  this->type_off   = this->stream_offset();
+  this->is_decoded = false;
+}
+
+void
+RdbStatsOutput::d_start_key( void ) noexcept
+{
+  this->is_decoded = true;
+  this->elems = this->bytes = 0;
+}
+
+void
+RdbStatsOutput::d_string( const RdbString &str ) noexcept
+{
+  this->elems  = 1;
+  this->bytes += str_size( str );
+}
+
+void
+RdbStatsOutput::d_module( const RdbString &str ) noexcept
+{
+  this->elems++;
+  this->bytes += str_size( str );
+}
+
+void
+RdbStatsOutput::d_hash( const RdbHashEntry &h ) noexcept
+{
+  this->elems++;
+  this->bytes += str_size( h.field ) + str_size( h.val );
+}
+
+void
+RdbStatsOutput::d_list( const RdbListElem &l ) noexcept
+{
+  this->elems++;
+  this->bytes += str_size( l.val );
+}
+
+void
+RdbStatsOutput::d_set( const RdbSetMember &s ) noexcept
+{
+  this->elems++;
+  this->bytes += str_size( s.member );
+}
+
+void
+RdbStatsOutput::d_zset( const RdbZSetMember &z ) noexcept
+{
+  this->elems++;
+  this->bytes += str_size( z.member ) + 8;
+}
+
+void
+RdbStatsOutput::d_stream_entry( const RdbStreamEntry &entry ) noexcept
+{
+  this->elems++;
+  for ( size_t i = 0; i < entry.entry_field_count; i++ ) {
+    const RdbListValue & f = entry.fields[ i ],
+                       & v = entry.values[ i ];
+    this->bytes += ( f.data != NULL ? f.data_len : 8 ) +
+                   ( v.data != NULL ? v.data_len : 8 );
+  }
+}
+
+void
+RdbStatsOutput::end_key( void ) noexcept
+{
+  RdbTypeStats & ts  = this->type[ this->cls ];
+  uint64_t       enc = this->stream_offset() - this->type_off;
+  int            b   = 0;
+
+  if ( this->sample != NULL ? ! this->sample->in_pop : ! this->is_decoded )
+    return;
+  this->key_cnt++;
+  ts.keys++;
+  ts.enc_bytes += enc;
+  if ( this->dec.expire_ms != 0 ) {
+    ts.expires++;
+    if ( this->dec.expire_ms <= this->now_ms )
+      this->expired_cnt++;
+  }
+  while ( b < 63 && ( enc >> ( b + 1 ) ) != 0 )
+    b++;
+  this->size_hist[ b ]++;
+  if ( this->is_decoded ) {
+    ts.s_keys++;
+    ts.s_elems    += this->elems;
+    ts.s_bytes    += this->bytes;
+    ts.s_elems_sq += (double) this->elems * (double) this->elems;
+    ts.s_bytes_sq += (double) this->bytes * (double) this->bytes;
+    if ( this->elems > ts.max_elems )
+      ts.max_elems = this->elems;
+    if ( this->bytes > ts.max_bytes )
+      ts.max_bytes = this->bytes;
+  }
+  if ( this->top_k != 0 ) {
+    uint64_t db = this->dec.db;
+    this->top_bytes[ this->cls ].add( enc, db, this->dec.key );
+    if ( this->is_decoded )
+      this->top_elems[ this->cls ].add( this->elems, db, this->dec.key );
+    if ( this->dec.has_idle ) {
+      this->hot_idle.add( this->dec.idle, db, this->dec.key );
+      this->cold_idle.add( this->dec.idle, db, this->dec.key );
+    }
+    if ( this->dec.has_freq ) {
+      this->hot_freq.add( this->dec.freq, db, this->dec.key );
+      this->cold_freq.add( this->dec.freq, db, this->dec.key );
+    }
+  }
+}
+
+bool
+RdbStatsOutput::set_top( size_t k ) noexcept
+{
+  for ( int i = 0; i < TYPE_CLASSES; i++ ) {
+    if ( ! this->top_bytes[ i ].init( k, false ) ||
+         ! this->top_elems[ i ].init( k, false ) )
+      return false;
+  }
+  if ( ! this->hot_idle.init( k, true ) || ! this->cold_idle.init( k, false ) ||
+       ! this->hot_freq.init( k, false ) || ! this->cold_freq.init( k, true ) )
+    return false;
+  this->top_k = k;
+  return true;
+}
+
+void
+RdbStatsOutput::d_finish( bool success ) noexcept
+{
+  if ( success )
+    this->print();
+}
+
+void
+RdbStatsOutput::print( void ) noexcept
+{
+  bool     sampled = ( this->sample != NULL );
+  uint64_t s_keys = 0, enc_bytes = 0, expires = 0;
+  int      i;
+
+  for ( i = 0; i < TYPE_CLASSES; i++ ) {
+    s_keys    += this->type[ i ].s_keys;
+    enc_bytes += this->type[ i ].enc_bytes;
+    expires   += this->type[ i ].expires;
+  }
+  printf( "keys %" PRIu64 ", decoded %" PRIu64 " (%.2f%%), "
+          "with expire %" PRIu64 ", expired %" PRIu64 ", encoded bytes %"
+          PRIu64 "\n", this->key_cnt, s_keys,
+          this->key_cnt ? 100.0 * (double) s_keys / (double) this->key_cnt : 0,
+          expires, this->expired_cnt, enc_bytes );
+  if ( sampled )
+    printf( "elems and elem_bytes are estimated from the sample, "
+            "+/- is a 95%% interval\n" );
+  printf( "%-8s %12s %7s %14s %24s %28s %10s %12s\n", "type", "keys",
+          "expire%", "enc_bytes", "elems", "elem_bytes", "max_elems",
+          "max_bytes" );
+  for ( i = 0; i < TYPE_CLASSES; i++ ) {
+    const RdbTypeStats & ts = this->type[ i ];
+    RdbEstimate el, by;
+    char        el_buf[ 64 ], by_buf[ 64 ];
+    if ( ts.keys == 0 )
+      continue;
+    el.compute( (double) ts.s_elems, ts.s_elems_sq, ts.s_keys, ts.keys );
+    by.compute( (double) ts.s_bytes, ts.s_bytes_sq, ts.s_keys, ts.keys );
+    if ( ts.s_keys == 0 ) {
+      ::strcpy( el_buf, "-" );
+      ::strcpy( by_buf, "-" );
+    }
+    else if ( ! sampled ) {
+      snprintf( el_buf, sizeof( el_buf ), "%" PRIu64, ts.s_elems );
+      snprintf( by_buf, sizeof( by_buf ), "%" PRIu64, ts.s_bytes );
+    }
+    else {
+      snprintf( el_buf, sizeof( el_buf ), "%.0f +/- %.0f", el.total, el.err );
+      snprintf( by_buf, sizeof( by_buf ), "%.0f +/- %.0f", by.total, by.err );
+    }
+    printf( "%-8s %12" PRIu64 " %6.1f%% %14" PRIu64 " %24s %28s %10" PRIu64
+            " %12" PRIu64 "\n", stats_type_name[ i ], ts.keys,
+            100.0 * (double) ts.expires / (double) ts.keys, ts.enc_bytes,
+            el_buf, by_buf, ts.max_elems, ts.max_bytes );
+  }
+  printf( "%-22s %12s\n", "encoded key size", "keys" );
+  for ( i = 0; i < 64; i++ ) {
+    char range[ 48 ];
+    if ( this->size_hist[ i ] == 0 )
+      continue;
+    snprintf( range, sizeof( range ), "%" PRIu64 "-%" PRIu64,
+              (uint64_t) 1 << i,
+              i == 63 ? ~(uint64_t) 0 : ( (uint64_t) 2 << i ) - 1 );
+    printf( "%-22s %12" PRIu64 "\n", range, this->size_hist[ i ] );
+  }
+  if ( this->top_k == 0 )
+    return;
+  for ( i = 0; i < TYPE_CLASSES; i++ ) {
+    char title[ 64 ];
+    snprintf( title, sizeof( title ), "largest %s keys",
+              stats_type_name[ i ] );
+    this->print_top( this->top_bytes[ i ], title, "enc_bytes" );
+    snprintf( title, sizeof( title ), "most elements %s keys",
+              stats_type_name[ i ] );
+    this->print_top( this->top_elems[ i ], title, "elems" );
+  }
+  this->print_top( this->hot_idle, "hot keys by idle", "idle" );
+  this->print_top( this->cold_idle, "cold keys by idle", "idle" );
+  this->print_top( this->hot_freq, "hot keys by freq", "freq" );
+  this->print_top( this->cold_freq, "cold keys by freq", "freq" );
+}
+
+void
+RdbStatsOutput::print_top( RdbTopK &top,  const char *title,
+                           const char *val_name ) noexcept
+{
+  if ( top.cnt == 0 )
+    return;
+  top.sort();
+  printf( "%s\n%-4s %14s %4s %s\n", title, "rank", val_name, "db", "key" );
+  for ( size_t i = 0; i < top.cnt; i++ ) {
+    const RdbTopEntry & e = top.heap[ i ];
+    size_t len = e.key_len < RdbTopEntry::KEY_MAX ? e.key_len :
+                 RdbTopEntry::KEY_MAX;
+    RdbString key;
+    key.set( e.key, len );
+    printf( "%-4" PRIu64 " %14" PRIu64 " %4" PRIu64 " ",
+            (uint64_t) i + 1, top.value( i ), e.db );
+    print_s( key );
+    if ( len < e.key_len )
+      printf( "... (%" PRIu64 " bytes)", (uint64_t) e.key_len );
+    printf( "\n" );
+  }
+  top.cnt = 0;
+}
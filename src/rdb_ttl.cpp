@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <rdbparser/rdb_decode.h>
+#include <rdbparser/rdb_json.h>
+#include <rdbparser/rdb_restore.h>
+#include <rdbparser/rdb_where.h>
+#include <rdbparser/rdb_ttl.h>
+
+using namespace rdbparser;
+
+static const char *ttl_type_name[ RdbTtlOutput::TYPE_CLASSES ] = {
+  "string", "list", "set", "zset", "hash", "stream", "module", "unknown"
+};
+
+static const char *ttl_bucket_name[ TTL_BUCKETS ] = {
+  "expired", "<1m", "<1h", "<1d", "<1w", "<30d", "<1y", ">=1y", "never"
+};
+
+uint64_t
+RdbTtlCount::total_keys( void ) const noexcept
+{
+  uint64_t n = 0;
+  for ( int i = 0; i < TTL_BUCKETS; i++ )
+    n += this->keys[ i ];
+  return n;
+}
+
+uint64_t
+RdbTtlCount::total_bytes( void ) const noexcept
+{
+  uint64_t n = 0;
+  for ( int i = 0; i < TTL_BUCKETS; i++ )
+    n += this->bytes[ i ];
+  return n;
+}
+
+RdbTtlOutput::RdbTtlOutput( RdbDecode &dec,  RdbBufptr &b ) noexcept
+  : RdbOutput( dec ), bptr( b ), pre( 0 ), pre_size( 0 ), type_off( 0 ),
+    cls( 0 ), failed( false )
+{
+  ::memset( &this->total, 0, sizeof( this->total ) );
+  ::memset( this->type, 0, sizeof( this->type ) );
+  this->now_ms = RestoreOutput::current_time_ms();
+}
+
+RdbTtlOutput::~RdbTtlOutput() noexcept
+{
+  if ( this->pre != NULL )
+    ::free( this->pre );
+}
+
+bool
+RdbTtlOutput::set_prefix( char c,  size_t d ) noexcept
+{
+  return this->prefix.init( c, d );
+}
+
+RdbTtlBucket
+RdbTtlOutput::bucket( uint64_t expire_ms,  uint64_t now_ms ) noexcept
+{
+  static const int64_t sec = 1000, day = 24 * 3600 * sec;
+  int64_t ms;
+
+  if ( expire_ms == 0 )
+    return TTL_NEVER;
+  ms = (int64_t) expire_ms - (int64_t) now_ms;
+  return ms <= 0           ? TTL_EXPIRED :
+         ms < 60 * sec     ? TTL_1M :
+         ms < 3600 * sec   ? TTL_1H :
+         ms < day          ? TTL_1D :
+         ms < 7 * day      ? TTL_1W :
+         ms < 30 * day     ? TTL_30D :
+         ms < 365 * day    ? TTL_1Y : TTL_MORE;
+}
+
+void
+RdbTtlOutput::d_start_type( RdbType t ) noexcept
+{
+  int c = RdbWhereFilter::rdb_type_class( t );
+  this->cls      = ( c < 0 ? TYPE_CLASSES - 1 : c );
+  this->type_off = this->stream_offset();
+}
+
+RdbTtlCount *
+RdbTtlOutput::prefix_count( void ) noexcept
+{
+  size_t idx, cnt = this->prefix.cnt;
+
+  if ( ! this->prefix.find( this->dec.key, idx ) )
+    return NULL;
+  if ( idx == cnt ) { /* new prefix */
+    if ( idx == this->pre_size ) {
+      size_t sz = this->prefix.ent_size;
+      RdbTtlCount * p =
+        (RdbTtlCount *) ::realloc( this->pre, sz * sizeof( p[ 0 ] ) );
+      if ( p == NULL ) {
+        ::perror( "realloc" );
+        return NULL;
+      }
+      this->pre      = p;
+      this->pre_size = sz;
+    }
+    ::memset( &this->pre[ idx ], 0, sizeof( this->pre[ idx ] ) );
+    this->pre[ idx ].idx = idx;
+  }
+  return &this->pre[ idx ];
+}
+
+void
+RdbTtlOutput::d_end_key( void ) noexcept
+{
+  uint64_t     enc = this->stream_offset() - this->type_off;
+  RdbTtlBucket b   = bucket( this->dec.expire_ms, this->now_ms );
+
+  this->total.keys[ b ]++;
+  this->total.bytes[ b ] += enc;
+  this->type[ this->cls ].keys[ b ]++;
+  this->type[ this->cls ].bytes[ b ] += enc;
+  if ( this->prefix.mask != 0 && ! this->failed ) {
+    RdbTtlCount * p = this->prefix_count();
+    if ( p == NULL )
+      this->failed = true;
+    else {
+      p->keys[ b ]++;
+      p->bytes[ b ] += enc;
+    }
+  }
+}
+
+void
+RdbTtlOutput::print_row( const RdbTtlCount &cnt ) noexcept
+{
+  uint64_t keys = cnt.total_keys();
+  printf( "%12" PRIu64 " %14" PRIu64 " %6.1f%%", keys, cnt.total_bytes(),
+          keys ? 100.0 * (double) cnt.keys[ TTL_NEVER ] / (double) keys : 0 );
+  for ( int i = 0; i < TTL_BUCKETS; i++ )
+    printf( " %12" PRIu64, cnt.bytes[ i ] );
+  printf( " " );
+}
+
+static int
+cmp_ttl_prefix( const void *a,  const void *b )
+{
+  uint64_t x = ( (const RdbTtlCount *) a )->total_bytes(),
+           y = ( (const RdbTtlCount *) b )->total_bytes();
+  return x > y ? -1 : x < y ? 1 : 0;
+}
+
+static void
+print_header( const char *title ) noexcept
+{
+  printf( "%12s %14s %7s", "keys", "enc_bytes", "never%" );
+  for ( int i = 0; i < TTL_BUCKETS; i++ )
+    printf( " %12s", ttl_bucket_name[ i ] );
+  printf( " %s\n", title );
+}
+
+void
+RdbTtlOutput::print( void ) noexcept
+{
+  uint64_t keys  = this->total.total_keys(),
+           bytes = this->total.total_bytes(),
+           cum   = 0;
+  int      i;
+
+  /* the keys and bytes freed by each time */
+  printf( "%-8s %12s %7s %14s %7s %7s\n", "expires", "keys", "keys%",
+          "enc_bytes", "bytes%", "freed%" );
+  for ( i = 0; i < TTL_BUCKETS; i++ ) {
+    if ( i != TTL_NEVER )
+      cum += this->total.bytes[ i ];
+    printf( "%-8s %12" PRIu64 " %6.1f%% %14" PRIu64 " %6.1f%% %6.1f%%\n",
+            ttl_bucket_name[ i ], this->total.keys[ i ],
+            keys ? 100.0 * (double) this->total.keys[ i ] / (double) keys : 0,
+            this->total.bytes[ i ],
+            bytes ? 100.0 * (double) this->total.bytes[ i ] /
+                    (double) bytes : 0,
+            bytes ? 100.0 * (double) cum / (double) bytes : 0 );
+  }
+  /* encoded bytes in each bucket, by type */
+  print_header( "type" );
+  for ( i = 0; i < TYPE_CLASSES; i++ ) {
+    if ( this->type[ i ].total_keys() == 0 )
+      continue;
+    print_row( this->type[ i ] );
+    printf( "%s\n", ttl_type_name[ i ] );
+  }
+  if ( this->prefix.mask == 0 || this->failed )
+    return;
+  /* by prefix, largest first */
+  ::qsort( this->pre, this->prefix.cnt, sizeof( RdbTtlCount ),
+           cmp_ttl_prefix );
+  print_header( "prefix" );
+  for ( size_t j = 0; j < this->prefix.cnt; j++ ) {
+    const RdbTtlCount & p = this->pre[ j ];
+    RdbString s;
+    s.set( this->prefix.prefix( p.idx ), this->prefix.ent[ p.idx ].len );
+    print_row( p );
+    print_s( s );
+    printf( "\n" );
+  }
+}
+
+void
+RdbTtlOutput::d_finish( bool success ) noexcept
+{
+  if ( success )
+    this->print();
+}
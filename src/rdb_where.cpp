@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <rdbparser/rdb_decode.h>
+#include <rdbparser/rdb_restore.h>
+#include <rdbparser/rdb_where.h>
+
+#ifdef _MSC_VER
+#define strncasecmp _strnicmp
+#endif
+using namespace rdbparser;
+
+static const char *type_class_name[] = {
+  "string", "list", "set", "zset", "hash", "stream", "module"
+};
+static const size_t type_class_cnt =
+  sizeof( type_class_name ) / sizeof( type_class_name[ 0 ] );
+
+static const char *field_name[] = {
+  "type", "ttl", "expire", "db", "len", "idle", "freq"
+};
+static const size_t field_cnt = sizeof( field_name ) / sizeof( field_name[ 0 ] );
+
+int
+RdbWhereFilter::rdb_type_class( RdbType t ) noexcept
+{
+  switch ( t ) {
+    case RDB_STRING:             return 0;
+    case RDB_LIST:
+    case RDB_LIST_ZIPLIST:
+    case RDB_LIST_QUICKLIST:
+    case RDB_LIST_QUICKLIST_2:   return 1;
+    case RDB_SET:
+    case RDB_SET_INTSET:         return 2;
+    case RDB_ZSET:
+    case RDB_ZSET_2:
+    case RDB_ZSET_ZIPLIST:
+    case RDB_ZSET_LISTPACK:      return 3;
+    case RDB_HASH:
+    case RDB_HASH_ZIPMAP:
+    case RDB_HASH_ZIPLIST:
+    case RDB_HASH_LISTPACK:      return 4;
+    case RDB_STREAM_LISTPACK:
+    case RDB_STREAM_LISTPACKS_2: return 5;
+    case RDB_MODULE:
+    case RDB_MODULE_2:           return 6;
+    default:                     return -1;
+  }
+}
+
+int
+RdbWhereFilter::type_class( const char *s,  size_t len ) noexcept
+{
+  for ( size_t i = 0; i < type_class_cnt; i++ )
+    if ( ::strlen( type_class_name[ i ] ) == len &&
+         ::strncasecmp( s, type_class_name[ i ], len ) == 0 )
+      return (int) i;
+  return -1;
+}
+
+bool
+RdbWhereFilter::parse( const char *expr ) noexcept
+{
+  const char * p = expr, * s;
+  size_t       i, len;
+
+  this->pred_cnt = 0;
+  this->now_ms   = RestoreOutput::current_time_ms();
+  for (;;) {
+    RdbWherePred pr;
+    while ( isspace( (uint8_t) *p ) )
+      p++;
+    /* field */
+    for ( s = p; isalpha( (uint8_t) *p ); p++ )
+      ;
+    len = (size_t) ( p - s );
+    for ( i = 0; i < field_cnt; i++ )
+      if ( ::strlen( field_name[ i ] ) == len &&
+           ::strncasecmp( s, field_name[ i ], len ) == 0 )
+        break;
+    if ( len == 0 || i == field_cnt ) {
+      fprintf( stderr, "where: expected a field at \"%s\"\n", s );
+      return false;
+    }
+    pr.field = (RdbWhereField) i;
+    while ( isspace( (uint8_t) *p ) )
+      p++;
+    /* op */
+    if ( p[ 0 ] == '!' && p[ 1 ] == '=' )      { pr.op = WHERE_NE; p += 2; }
+    else if ( p[ 0 ] == '<' && p[ 1 ] == '=' ) { pr.op = WHERE_LE; p += 2; }
+    else if ( p[ 0 ] == '>' && p[ 1 ] == '=' ) { pr.op = WHERE_GE; p += 2; }
+    else if ( p[ 0 ] == '=' && p[ 1 ] == '=' ) { pr.op = WHERE_EQ; p += 2; }
+    else if ( p[ 0 ] == '=' )                  { pr.op = WHERE_EQ; p += 1; }
+    else if ( p[ 0 ] == '<' )                  { pr.op = WHERE_LT; p += 1; }
+    else if ( p[ 0 ] == '>' )                  { pr.op = WHERE_GT; p += 1; }
+    else {
+      fprintf( stderr, "where: expected an operator at \"%s\"\n", p );
+      return false;
+    }
+    while ( isspace( (uint8_t) *p ) )
+      p++;
+    /* value */
+    for ( s = p; *p != '\0' && ! isspace( (uint8_t) *p ); p++ )
+      ;
+    len = (size_t) ( p - s );
+    pr.val     = 0;
+    pr.is_none = ( len == 4 && ::strncasecmp( s, "none", 4 ) == 0 );
+    if ( pr.is_none ) {
+      if ( pr.field == WHERE_TYPE || pr.field == WHERE_DB ||
+           pr.field == WHERE_LEN ||
+           ( pr.op != WHERE_EQ && pr.op != WHERE_NE ) ) {
+        fprintf( stderr, "where: %s can't compare with none\n",
+                 field_name[ pr.field ] );
+        return false;
+      }
+    }
+    else if ( pr.field == WHERE_TYPE ) {
+      int t = type_class( s, len );
+      if ( t < 0 || ( pr.op != WHERE_EQ && pr.op != WHERE_NE ) ) {
+        fprintf( stderr, "where: type %.*s should be = or != one of string,"
+                 " list, set, zset, hash, stream, module\n", (int) len, s );
+        return false;
+      }
+      pr.val = t;
+    }
+    else {
+      char * e;
+      pr.val = ::strtoll( s, &e, 10 );
+      if ( len == 0 || e != p ) {
+        fprintf( stderr, "where: expected a number at \"%s\"\n", s );
+        return false;
+      }
+    }
+    if ( this->pred_cnt == MAX_PRED ) {
+      fprintf( stderr, "where: more than %u predicates\n",
+               (unsigned int) MAX_PRED );
+      return false;
+    }
+    this->pred[ this->pred_cnt++ ] = pr;
+    while ( isspace( (uint8_t) *p ) )
+      p++;
+    if ( *p == '\0' )
+      return true;
+    if ( ::strncasecmp( p, "and", 3 ) != 0 || ! isspace( (uint8_t) p[ 3 ] ) ) {
+      fprintf( stderr, "where: expected \"and\" at \"%s\"\n", p );
+      return false;
+    }
+    p += 3;
+  }
+}
+
+bool
+RdbWhereFilter::add_pred( RdbWhereField f,  RdbWhereOp op,
+                          int64_t val ) noexcept
+{
+  if ( this->pred_cnt == MAX_PRED ) {
+    fprintf( stderr, "where: more than %u predicates\n",
+             (unsigned int) MAX_PRED );
+    return false;
+  }
+  if ( this->pred_cnt == 0 )
+    this->now_ms = RestoreOutput::current_time_ms();
+  RdbWherePred & pr = this->pred[ this->pred_cnt++ ];
+  pr.field   = f;
+  pr.op      = op;
+  pr.val     = val;
+  pr.is_none = false;
+  return true;
+}
+
+bool
+RdbWhereFilter::eval( const RdbWherePred &pr ) const noexcept
+{
+  const RdbDecode & d = this->dec;
+  bool    present = true;
+  int64_t x = 0;
+
+  switch ( pr.field ) {
+    case WHERE_TYPE:   x = rdb_type_class( d.type ); break;
+    case WHERE_DB:     x = (int64_t) d.db; break;
+    case WHERE_LEN:    x = (int64_t) d.rlen.len; break;
+    case WHERE_EXPIRE:
+      present = ( d.expire_ms != 0 );
+      x = (int64_t) d.expire_ms;
+      break;
+    case WHERE_TTL:
+      present = ( d.expire_ms != 0 );
+      x = (int64_t) d.expire_ms - (int64_t) this->now_ms;
+      /* floor, so a key expired less than a second ago is -1, not 0 */
+      x = ( x >= 0 ? x / 1000 : -( ( 999 - x ) / 1000 ) );
+      break;
+    case WHERE_IDLE:
+      present = d.has_idle;
+      x = (int64_t) d.idle;
+      break;
+    case WHERE_FREQ:
+      present = d.has_freq;
+      x = (int64_t) d.freq;
+      break;
+  }
+  if ( pr.is_none )
+    return ( pr.op == WHERE_EQ ) ? ! present : present;
+  if ( ! present )
+    return false;
+  switch ( pr.op ) {
+    case WHERE_EQ: return x == pr.val;
+    case WHERE_NE: return x != pr.val;
+    case WHERE_LT: return x <  pr.val;
+    case WHERE_LE: return x <= pr.val;
+    case WHERE_GT: return x >  pr.val;
+    case WHERE_GE: return x >= pr.val;
+  }
+  return false;
+}
+
+bool
+RdbWhereFilter::match_key( const RdbString &key ) noexcept
+{
+  for ( size_t i = 0; i < this->pred_cnt; i++ )
+    if ( ! this->eval( this->pred[ i ] ) )
+      return false;
+  if ( this->next != NULL )
+    return this->next->match_key( key );
+  return true;
+}
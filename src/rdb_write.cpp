@@ -0,0 +1,449 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+extern "C" {
+#include <lzf.h>
+}
+#include <rdbparser/rdb_decode.h>
+#include <rdbparser/rdb_encode.h>
+#include <rdbparser/rdb_write.h>
+
+using namespace rdbparser;
+
+bool
+RdbWriter::set_version( uint16_t v ) noexcept
+{
+  if ( v < MIN_VERSION || v > MAX_VERSION )
+    return false;
+  this->ver    = v;
+  this->tc.ver = v;
+  return true;
+}
+
+bool
+RdbWriter::open( const char *fn ) noexcept
+{
+  FILE * f = ::fopen( fn, "wb" );
+  if ( f == NULL ) {
+    ::perror( fn );
+    return false;
+  }
+  if ( ! this->open( f ) ) {
+    ::fclose( f );
+    return false;
+  }
+  this->own_fp = true;
+  return true;
+}
+
+bool
+RdbWriter::open( FILE *f ) noexcept
+{
+  char hdr[ 16 ];
+  this->buf = (uint8_t *) ::malloc( BUF_SIZE );
+  if ( this->buf == NULL ) {
+    ::perror( "malloc" );
+    return false;
+  }
+  this->fp        = f;
+  this->buf_size  = BUF_SIZE;
+  this->buf_len   = 0;
+  this->crc       = 0;
+  this->out_bytes = 0;
+  this->key_cnt   = 0;
+  this->failed    = false;
+  this->tc.ver    = this->ver;
+  int n = snprintf( hdr, sizeof( hdr ), "REDIS%04u", this->ver );
+  this->put( hdr, n );
+  return true;
+}
+
+void
+RdbWriter::flush( void ) noexcept
+{
+  if ( this->buf_len == 0 )
+    return;
+  this->crc = jones_crc64( this->crc, this->buf, this->buf_len );
+  if ( ! this->failed &&
+       ::fwrite( this->buf, 1, this->buf_len, this->fp ) != this->buf_len ) {
+    ::perror( "fwrite" );
+    this->failed = true;
+  }
+  this->out_bytes += this->buf_len;
+  this->buf_len    = 0;
+}
+
+bool
+RdbWriter::finish( void ) noexcept
+{
+  uint8_t tmp[ 8 ];
+  if ( this->fp == NULL )
+    return false;
+  this->put_byte( RDB_EOF );
+  this->flush();
+  le<uint64_t>( tmp, this->crc );
+  if ( ! this->failed && ::fwrite( tmp, 1, 8, this->fp ) != 8 ) {
+    ::perror( "fwrite" );
+    this->failed = true;
+  }
+  this->out_bytes += 8;
+  if ( ::fflush( this->fp ) != 0 ) {
+    ::perror( "fflush" );
+    this->failed = true;
+  }
+  bool ok = ! this->failed;
+  this->close();
+  return ok;
+}
+
+void
+RdbWriter::close( void ) noexcept
+{
+  if ( this->own_fp && this->fp != NULL )
+    ::fclose( this->fp );
+  if ( this->buf != NULL )
+    ::free( this->buf );
+  if ( this->zbuf != NULL )
+    ::free( this->zbuf );
+  this->fp        = NULL;
+  this->own_fp    = false;
+  this->buf       = NULL;
+  this->zbuf      = NULL;
+  this->buf_size  = 0;
+  this->zbuf_size = 0;
+}
+
+void
+RdbWriter::put( const void *p,  size_t len ) noexcept
+{
+  if ( this->buf_len + len > this->buf_size ) {
+    this->flush();
+    /* larger than buffer, write it directly */
+    if ( len > this->buf_size ) {
+      this->crc = jones_crc64( this->crc, p, len );
+      if ( ! this->failed && ::fwrite( p, 1, len, this->fp ) != len ) {
+        ::perror( "fwrite" );
+        this->failed = true;
+      }
+      this->out_bytes += len;
+      return;
+    }
+  }
+  ::memcpy( &this->buf[ this->buf_len ], p, len );
+  this->buf_len += len;
+}
+
+void
+RdbWriter::put_len( uint64_t len ) noexcept
+{
+  RdbLenEncode enc;
+  uint8_t      tmp[ 16 ];
+  this->put( tmp, enc.len_encode( tmp, len ) );
+}
+
+void
+RdbWriter::put_int( int64_t ival ) noexcept
+{
+  RdbLenEncode enc;
+  uint8_t      tmp[ 32 ];
+  if ( enc.int_size( ival ) != 0 ) {
+    this->put( tmp, enc.int_encode( tmp ) );
+    return;
+  }
+  /* too large for int32 encoding */
+  int n = snprintf( (char *) tmp, sizeof( tmp ), "%" PRId64, ival );
+  this->put_len( n );
+  this->put( tmp, n );
+}
+
+void
+RdbWriter::put_str( const void *p,  size_t len ) noexcept
+{
+  int64_t ival;
+  /* short strings which are canonical integers */
+  if ( len <= 11 && str_to_int( (const char *) p, len, ival ) &&
+       RdbLength::int_code( ival ) != RdbLength::RDB_LEN_ERR ) {
+    this->put_int( ival );
+    return;
+  }
+  if ( this->compress && len > LZF_MIN_SIZE ) {
+    if ( this->zbuf_size < len ) {
+      uint8_t * z = (uint8_t *) ::realloc( this->zbuf, len );
+      if ( z != NULL ) {
+        this->zbuf      = z;
+        this->zbuf_size = len;
+      }
+    }
+    if ( this->zbuf_size >= len ) {
+      /* must save at least 4 bytes, like redis */
+      unsigned int zlen = lzf_compress( p, (unsigned int) len, this->zbuf,
+                                        (unsigned int) ( len - 4 ) );
+      if ( zlen != 0 ) {
+        this->put_byte( 0xc3 ); /* lzf <zlen> <len> */
+        this->put_len( zlen );
+        this->put_len( len );
+        this->put( this->zbuf, zlen );
+        return;
+      }
+    }
+  }
+  this->put_len( len );
+  this->put( p, len );
+}
+
+void
+RdbWriter::put_str( const RdbString &str ) noexcept
+{
+  char tmp[ 32 ];
+  switch ( str.coding ) {
+    case RDB_INT_VAL:
+      this->put_int( str.ival );
+      break;
+    case RDB_STR_VAL:
+      this->put_str( str.s, str.s_len );
+      break;
+    case RDB_DBL_VAL: {
+      int n = snprintf( tmp, sizeof( tmp ), "%.17g", str.fval );
+      this->put_str( tmp, n );
+      break;
+    }
+    default:
+      this->put_len( 0 );
+      break;
+  }
+}
+
+void
+RdbWriter::put_meta( void ) noexcept
+{
+  uint8_t tmp[ 8 ];
+  if ( this->expire_ms != 0 ) {
+    this->put_byte( RDB_EXPIRED_MS );
+    le<uint64_t>( tmp, this->expire_ms );
+    this->put( tmp, 8 );
+  }
+  if ( this->has_idle ) {
+    this->put_byte( RDB_IDLE );
+    this->put_len( this->idle );
+  }
+  else if ( this->has_freq ) {
+    this->put_byte( RDB_FREQ );
+    this->put_byte( this->freq );
+  }
+  this->expire_ms = 0;
+  this->has_idle  = false;
+  this->has_freq  = false;
+  this->key_cnt++;
+}
+
+void
+RdbWriter::put_key_meta( RdbType t,  const RdbString &key ) noexcept
+{
+  this->put_meta();
+  this->put_byte( (uint8_t) t );
+  this->put_str( key );
+}
+
+void
+RdbWriter::aux( const char *name,  const char *val ) noexcept
+{
+  this->put_byte( RDB_AUX );
+  this->put_str( name, ::strlen( name ) );
+  this->put_str( val, ::strlen( val ) );
+}
+
+void
+RdbWriter::aux( const char *name,  int64_t val ) noexcept
+{
+  this->put_byte( RDB_AUX );
+  this->put_str( name, ::strlen( name ) );
+  this->put_int( val );
+}
+
+void
+RdbWriter::select_db( uint64_t db ) noexcept
+{
+  this->put_byte( RDB_DBSELECT );
+  this->put_len( db );
+}
+
+void
+RdbWriter::resize_db( uint64_t db_size,  uint64_t expires_size ) noexcept
+{
+  this->put_byte( RDB_DBRESIZE );
+  this->put_len( db_size );
+  this->put_len( expires_size );
+}
+
+void
+RdbWriter::string( const RdbString &key,  const RdbString &val ) noexcept
+{
+  this->put_key_meta( RDB_STRING, key );
+  this->put_str( val );
+}
+
+void
+RdbWriter::list( const RdbString &key,  const RdbString *elem,
+                 size_t cnt ) noexcept
+{
+  if ( cnt == 0 )
+    return;
+  this->tc.start( RDB_LIST );
+  for ( size_t i = 0; i < cnt; i++ )
+    this->tc.push( elem[ i ] );
+  if ( this->tc.encode() == RdbTranscode::TC_ENCODED ) {
+    this->put_key_meta( this->tc.type, key );
+    this->put( this->tc.buf, this->tc.buf_len );
+    return;
+  }
+  /* only when out of memory */
+  ::perror( "list" );
+  this->failed = true;
+}
+
+static int
+cmp_int64( const void *x,  const void *y )
+{
+  int64_t a = *(const int64_t *) x, b = *(const int64_t *) y;
+  return a < b ? -1 : a > b ? 1 : 0;
+}
+
+/* intset: [encoding(4)][length(4)][ints sorted, all the same width] */
+bool
+RdbWriter::put_intset( const RdbString *mem,  size_t cnt ) noexcept
+{
+  int64_t * ival = (int64_t *) ::malloc( sizeof( int64_t ) * cnt );
+  uint8_t * b;
+  size_t    i, n, width = 2;
+  if ( ival == NULL )
+    return false;
+  for ( i = 0; i < cnt; i++ ) {
+    if ( mem[ i ].coding == RDB_INT_VAL )
+      ival[ i ] = mem[ i ].ival;
+    else if ( mem[ i ].coding != RDB_STR_VAL ||
+              ! str_to_int( mem[ i ].s, mem[ i ].s_len, ival[ i ] ) ) {
+      ::free( ival );
+      return false;
+    }
+  }
+  ::qsort( ival, cnt, sizeof( int64_t ), cmp_int64 );
+  for ( i = 0, n = 0; i < cnt; i++ ) {
+    if ( n == 0 || ival[ n - 1 ] != ival[ i ] )
+      ival[ n++ ] = ival[ i ];
+  }
+  if ( ival[ 0 ] < INT32_MIN || ival[ n - 1 ] > INT32_MAX )
+    width = 8;
+  else if ( ival[ 0 ] < INT16_MIN || ival[ n - 1 ] > INT16_MAX )
+    width = 4;
+  if ( (b = (uint8_t *) ::malloc( 8 + n * width )) == NULL ) {
+    ::free( ival );
+    return false;
+  }
+  le<uint32_t>( b, (uint32_t) width );
+  le<uint32_t>( &b[ 4 ], (uint32_t) n );
+  for ( i = 0; i < n; i++ ) {
+    if ( width == 2 )
+      le<uint16_t>( &b[ 8 + i * 2 ], (uint16_t) ival[ i ] );
+    else if ( width == 4 )
+      le<uint32_t>( &b[ 8 + i * 4 ], (uint32_t) ival[ i ] );
+    else
+      le<uint64_t>( &b[ 8 + i * 8 ], (uint64_t) ival[ i ] );
+  }
+  this->put_str( b, 8 + n * width );
+  ::free( b );
+  ::free( ival );
+  return true;
+}
+
+static bool
+is_intset( const RdbString *mem,  size_t cnt )
+{
+  int64_t ival;
+  if ( cnt > RdbWriter::MAX_INTSET )
+    return false;
+  for ( size_t i = 0; i < cnt; i++ ) {
+    if ( mem[ i ].coding != RDB_INT_VAL &&
+         ( mem[ i ].coding != RDB_STR_VAL ||
+           ! str_to_int( mem[ i ].s, mem[ i ].s_len, ival ) ) )
+      return false;
+  }
+  return true;
+}
+
+void
+RdbWriter::set( const RdbString &key,  const RdbString *mem,
+                size_t cnt ) noexcept
+{
+  if ( cnt == 0 )
+    return;
+  if ( is_intset( mem, cnt ) ) {
+    this->put_key_meta( RDB_SET_INTSET, key );
+    if ( this->put_intset( mem, cnt ) )
+      return;
+    ::perror( "set" );
+    this->failed = true;
+    return;
+  }
+  this->put_key_meta( RDB_SET, key );
+  this->put_len( cnt );
+  for ( size_t i = 0; i < cnt; i++ )
+    this->put_str( mem[ i ] );
+}
+
+void
+RdbWriter::hash( const RdbString &key,  const RdbString *fv,
+                 size_t cnt ) noexcept
+{
+  if ( cnt == 0 )
+    return;
+  this->tc.start( RDB_HASH );
+  for ( size_t i = 0; i < cnt * 2; i++ )
+    this->tc.push( fv[ i ] );
+  if ( this->tc.encode() == RdbTranscode::TC_ENCODED ) {
+    this->put_key_meta( this->tc.type, key );
+    this->put( this->tc.buf, this->tc.buf_len );
+    return;
+  }
+  this->put_key_meta( RDB_HASH, key );
+  this->put_len( cnt );
+  for ( size_t i = 0; i < cnt * 2; i++ )
+    this->put_str( fv[ i ] );
+}
+
+void
+RdbWriter::zset( const RdbString &key,  const RdbString *ms,
+                 size_t cnt ) noexcept
+{
+  uint8_t tmp[ 8 ];
+  if ( cnt == 0 )
+    return;
+  this->tc.start( RDB_ZSET_2 );
+  for ( size_t i = 0; i < cnt * 2; i++ )
+    this->tc.push( ms[ i ] );
+  if ( this->tc.encode() == RdbTranscode::TC_ENCODED ) {
+    this->put_key_meta( this->tc.type, key );
+    this->put( this->tc.buf, this->tc.buf_len );
+    return;
+  }
+  /* member + binary double score */
+  this->put_key_meta( RDB_ZSET_2, key );
+  this->put_len( cnt );
+  for ( size_t i = 0; i < cnt * 2; i += 2 ) {
+    double   score = str_to_double( ms[ i + 1 ] );
+    uint64_t u;
+    this->put_str( ms[ i ] );
+    ::memcpy( &u, &score, sizeof( u ) );
+    le<uint64_t>( tmp, u );
+    this->put( tmp, 8 );
+  }
+}
+
+void
+RdbWriter::raw_key( const void *p,  size_t len ) noexcept
+{
+  this->put_meta();
+  this->put( p, len );
+}